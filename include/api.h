@@ -12,7 +12,11 @@
 
 #include "arp.h"
 #include "device.h"
+#include "forward.h"
+#include "icmp.h"
 #include "ip.h"
+#include "pipeline.h"
+#include "policer.h"
 #include "socket.h"
 #include "tcp.h"
 #include "type.h"
@@ -40,6 +44,10 @@ int connect(int socket, const struct sockaddr *address, socklen_t address_len);
 int accept(int socket, struct sockaddr *address, socklen_t *address_len);
 ssize_t read(int fildes, void *buf, size_t nbyte);
 ssize_t write(int fildes, const void *buf, size_t nbyte);
+ssize_t sendto(int socket, const void *buf, size_t nbyte, int flags,
+               const struct sockaddr *dest_addr, socklen_t dest_len);
+ssize_t recvfrom(int socket, void *buf, size_t nbyte, int flags,
+                 struct sockaddr *address, socklen_t *address_len);
 ssize_t close(int fildes);
 int getaddrinfo(const char *node, const char *service,
                 const struct addrinfo *hints, struct addrinfo **res);
@@ -86,6 +94,55 @@ int sendFrame(const void *buf, int len, int ethtype, const void *destmac,
  */
 int setFrameReceiveCallback(frameReceiveCallback callback);
 
+/**
+ * @brief Turn on or off the batch mode of receiving. In batch mode, devices
+ * receive up to `RX_BATCH_SIZE` frames at a time and push them through
+ * `Pipeline::processBatch`, IPv4 frames are handled by the IP layer directly.
+ *
+ * @param enable whether to turn on
+ * @return int 0 on success, -1 on error.
+ */
+int setBatchMode(bool enable);
+
+/**
+ * @brief Set the number of threads forwarding IP packets. Packets are spread
+ * over them by flow hash, zero to forward packets in the receiving thread.
+ *
+ * @param n number of threads, at most `FWD_MAX_WORKERS`
+ * @return int 0 on success, -1 on error.
+ */
+int setForwardWorkers(int n);
+
+/**
+ * @brief Get the number of packets dropped by forwarding threads too busy to
+ * take them
+ *
+ * @return uint64_t packets dropped.
+ */
+uint64_t getForwardDropped();
+
+/**
+ * @brief Set the ingress policer of a class of traffic. Packets over the rate
+ * of the class, or over the rate of their source, are dropped on receiving.
+ *
+ * @param c class of traffic
+ * @param rate packets per second of the whole class, 0 for no limit
+ * @param burst packets allowed at once above the rate of the class
+ * @param sourceRate packets per second of each source, 0 for no limit
+ * @param sourceBurst packets allowed at once above the rate of each source
+ * @return int 0 on success, -1 on error.
+ */
+int setPolicer(Policer::Class c, uint32_t rate, uint32_t burst,
+               uint32_t sourceRate, uint32_t sourceBurst);
+
+/**
+ * @brief Get the counters of the ingress policer of a class
+ *
+ * @param c class of traffic
+ * @return Policer::Counters packets passed and dropped.
+ */
+Policer::Counters getPolicerCounters(Policer::Class c);
+
 /**
  * @brief Send an IP packet to specified host.
  *
@@ -99,9 +156,19 @@ int setFrameReceiveCallback(frameReceiveCallback callback);
 int sendIPPacket(const struct in_addr src, const struct in_addr dest, int proto,
                  const void *buf, int len);
 
+/**
+ * @brief Send IP packets in a batch, the next hop of each destination is
+ * resolved once.
+ *
+ * @param packets packets to send
+ * @param n number of packets
+ * @return number of packets sent.
+ */
+int sendIPPackets(const Ip::Packet *packets, size_t n);
+
 /**
  * @brief Register a callback function to be called each time an IP packet
- * was received.
+ * was received, whose protocol has no callback set by `setProtocolCallback`.
  *
  * @param callback The callback function.
  * @return 0 on success, -1 on error.
@@ -109,6 +176,16 @@ int sendIPPacket(const struct in_addr src, const struct in_addr dest, int proto,
  */
 int setIPPacketReceiveCallback(IPPacketReceiveCallback callback);
 
+/**
+ * @brief Register a callback function to be called each time an IP packet
+ * with a protocol was received. TCP, UDP and ICMP are registered by `init`.
+ *
+ * @param proto Value of `protocol` field in IP header.
+ * @param callback The callback function, nullptr to remove.
+ * @return 0 on success, -1 on error.
+ */
+int setProtocolCallback(uint8_t proto, IPPacketReceiveCallback callback);
+
 /**
  * @brief Manully add an item to routing table. Useful when talking with real
  * Linux machines.
@@ -130,6 +207,16 @@ int setRoutingTable(const in_addr dest, const in_addr mask,
  */
 int addAllDevice(bool sniff = false);
 
+/**
+ * @brief Bond several devices into one virtual device sharing the ip and MAC
+ * address of the first member. Frames are spread over members by flow hash.
+ *
+ * @param name name of the bond
+ * @param members names of devices to bond
+ * @return int id of the bond, -1 on error
+ */
+int addBondDevice(const char *name, const std::vector<std::string> &members);
+
 /**
  * @brief Initial router algorithm.
  *
@@ -31,6 +31,12 @@ ssize_t __wrap_read(int fildes, void *buf, size_t nbyte);
 
 ssize_t __wrap_write(int fildes, const void *buf, size_t nbyte);
 
+ssize_t __wrap_sendto(int socket, const void *buf, size_t nbyte, int flags,
+                      const struct sockaddr *dest_addr, socklen_t dest_len);
+
+ssize_t __wrap_recvfrom(int socket, void *buf, size_t nbyte, int flags,
+                        struct sockaddr *address, socklen_t *address_len);
+
 ssize_t __wrap_close(int fildes);
 
 int __wrap_getaddrinfo(const char *node, const char *service,
@@ -17,9 +17,11 @@
 #include <atomic>
 #include <chrono>
 #include <condition_variable>
+#include <deque>
 #include <map>
 #include <mutex>
 #include <thread>
+#include <unordered_map>
 
 #include "device.h"
 #include "ether.h"
@@ -34,6 +36,30 @@ namespace Arp {
  */
 constexpr int ARP_TIMEOUT = 1;
 
+/**
+ * @brief requests sent for a neighbor before giving up its frames
+ *
+ */
+constexpr int ARP_MAX_RETRY = 5;
+
+/**
+ * @brief max frames waiting for one neighbor, the oldest one is dropped
+ *
+ */
+constexpr int ARP_PENDING_FRAMES = 16;
+
+/**
+ * @brief max neighbors being resolved at the same time
+ *
+ */
+constexpr int ARP_PENDING_NEIGHBORS = 256;
+
+/**
+ * @brief interval of checking neighbors being resolved (millisecond)
+ *
+ */
+constexpr int ARP_TICK = 100;
+
 /**
  * @brief The value of ar_op defined in if_arp.h
  *
@@ -66,21 +92,101 @@ class ArpFrame {
   void ntohType();
 };
 
+using ArpTable = std::unordered_map<ip_addr, MAC::MacAddr, IpHash>;
+
+/**
+ * @brief A neighbor being resolved and the frames waiting for it
+ *
+ */
+struct Pending {
+  Device::DevicePtr dev;
+  int retry;
+  std::chrono::steady_clock::time_point next;  // time to send request again
+  std::deque<Ether::EtherFrame> frames;
+};
+
 /**
  * @brief Manage all ARP items, request/reply an ARP frame
  *
+ * The ARP table is read-mostly: readers take an immutable snapshot without
+ * locking, writers copy the table and publish a new snapshot.
+ *
  */
 class ArpManager {
  public:
-  std::map<ip_addr, MAC::MacAddr> ipMacMap;
   std::condition_variable cv;
   std::mutex cv_m;  // mutex for cv
 
+  /**
+   * @brief Look up the ARP table
+   *
+   * @param ip ip address
+   * @param mac MAC address will be stored in
+   * @return true found
+   * @return false not found
+   */
+  bool lookup(const ip_addr& ip, MAC::MacAddr& mac);
+
+  /**
+   * @brief Add or update an ARP item
+   *
+   * @param ip ip address
+   * @param mac MAC address
+   */
+  void setMacAddr(const ip_addr& ip, const MAC::MacAddr& mac);
+
+  /**
+   * @brief Get a snapshot of the ARP table
+   *
+   * @return std::shared_ptr<const ArpTable> the table
+   */
+  std::shared_ptr<const ArpTable> getTable();
+
+  /**
+   * @brief Send a frame to a neighbor without waiting. If the MAC address of
+   * the neighbor is unknown, the frame is queued and an ARP request is sent.
+   * Queued frames are sent when the reply arrives, or dropped after
+   * `ARP_MAX_RETRY` requests without reply.
+   *
+   * @param dev device to send frame on
+   * @param dstIp ip address of the neighbor
+   * @param hdr frame header, the destination will be filled
+   * @param iov pieces of payload
+   * @param iovcnt number of pieces
+   * @return int 0 on success or queued, -1 on error
+   */
+  int sendFrame(Device::DevicePtr dev, const ip_addr& dstIp, ether_header& hdr,
+                const iovec* iov, int iovcnt);
+
+  /**
+   * @brief Get the MAC address of a neighbor, block until the reply arrives.
+   * Only for tools and tests, the stack itself uses `sendFrame`.
+   *
+   */
   MAC::MacAddr getMacAddr(Device::DevicePtr dev, const ip_addr& dstIp,
                           int maxRetry = 5);
   int sendRequestArp(Device::DevicePtr dev, const ip_addr& dstIp, int maxRetry);
   void sendReplyArp(Device::DevicePtr, const u_char* dstMac,
                     const ip_addr& dstIp);
+
+  /**
+   * @brief Send frames waiting for a neighbor whose MAC address is learnt
+   *
+   * @param ip ip address of the neighbor
+   * @param mac its MAC address
+   */
+  void flush(const ip_addr& ip, const MAC::MacAddr& mac);
+
+ private:
+  std::shared_ptr<const ArpTable> table = std::make_shared<ArpTable>();
+  std::mutex table_m;  // mutex for writers
+
+  std::unordered_map<ip_addr, Pending, IpHash> pending;
+  std::mutex pending_m;  // mutex for pending
+  std::once_flag timerFlag;
+
+  void sendRequest(Device::DevicePtr dev, const ip_addr& dstIp);
+  void timerLoop();
 };
 
 /**
@@ -0,0 +1,84 @@
+/**
+ * @file bond.h
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-02
+ *
+ * @brief Link aggregation: a virtual device bonding several devices.
+ *
+ */
+
+#ifndef BOND_H_
+#define BOND_H_
+
+#include "device.h"
+#include "flow.h"
+
+namespace Device {
+
+/**
+ * @brief A virtual device bonding several devices under one ip and MAC
+ * address.
+ *
+ * Frames are spread over members by rendezvous hashing of flows, so packets
+ * of one flow always leave on the same member, and a member going down moves
+ * its own flows only. A member marked down is probed with a frame now and
+ * then, and takes its flows back once a frame is sent on it. Frames received
+ * by any member are handled as if received by the bond.
+ *
+ */
+class BondDevice : public Device {
+ public:
+  /**
+   * @brief Construct a new Bond Device object
+   *
+   * @param name the name of bond
+   * @param members members, the first one gives ip and MAC address
+   */
+  BondDevice(std::string name, const std::vector<DevicePtr> &members);
+
+  /**
+   * @brief Send a frame on a member chosen by flow hash
+   *
+   * @param frame the frame will be sent
+   * @return int 0 on success, -1 if no member is up
+   */
+  int sendFrame(Ether::EtherFrame &frame) override;
+
+  /**
+   * @brief Send a frame gathered from pieces on a member chosen by flow hash
+   *
+   * @param hdr frame header
+   * @param iov pieces of payload
+   * @param iovcnt number of pieces
+   * @return int 0 on success, -1 if no member is up
+   */
+  int sendFrame(const ether_header &hdr, const iovec *iov,
+                int iovcnt) override;
+
+  /**
+   * @brief Send frames, each on a member chosen by flow hash. Frames to the
+   * same member are queued together.
+   *
+   * @param frames frames to send
+   * @param n number of frames
+   * @return int 0 on success, -1 on error
+   */
+  int sendFrames(const FrameRef *frames, int n) override;
+
+  /**
+   * @brief Get the members
+   *
+   * @return const std::vector<DevicePtr>& members
+   */
+  const std::vector<DevicePtr> &getMembers() { return members; }
+
+ private:
+  std::vector<DevicePtr> members;
+
+  DevicePtr pickMember(uint32_t hash);  // nullptr if no member is up
+};
+
+}  // namespace Device
+
+#endif  // BOND_H_
@@ -0,0 +1,74 @@
+/**
+ * @file checksum.h
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-05
+ *
+ * @brief Internet checksum (RFC 1071) with SIMD kernels. The fastest kernel
+ * supported by the CPU is selected at startup, all kernels give the same
+ * result as the scalar one.
+ *
+ */
+
+#ifndef CHECKSUM_H_
+#define CHECKSUM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Checksum {
+
+#define CHECKSUM_KERNEL_SET \
+  X(SCALAR)                 \
+  X(SSE2)                   \
+  X(AVX2)                   \
+  X(AVX512)
+
+enum class Kernel : int {
+#define X(KERNELNAME) KERNELNAME,
+  CHECKSUM_KERNEL_SET
+#undef X
+};
+
+std::string kernelToStr(Kernel k);
+
+/**
+ * @brief Whether the CPU supports a kernel
+ *
+ * @param k kernel
+ * @return true supported
+ * @return false not supported
+ */
+bool isSupported(Kernel k);
+
+/**
+ * @brief Get the kernel selected at startup
+ *
+ * @return Kernel the fastest kernel supported
+ */
+Kernel getKernel();
+
+/**
+ * @brief Get the checksum of a buffer with the selected kernel
+ *
+ * @param vdata buffer point
+ * @param length length
+ * @return uint16_t checksum result in network byte order
+ */
+uint16_t getChecksum(const void* vdata, size_t length);
+
+/**
+ * @brief Get the checksum of a buffer with a specific kernel. The kernel
+ * should be supported.
+ *
+ * @param k kernel
+ * @param vdata buffer point
+ * @param length length
+ * @return uint16_t checksum result in network byte order
+ */
+uint16_t getChecksum(Kernel k, const void* vdata, size_t length);
+
+}  // namespace Checksum
+
+#endif  // CHECKSUM_H_
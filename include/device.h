@@ -19,6 +19,7 @@
 #include <unistd.h>
 
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstring>
 #include <iostream>
@@ -36,6 +37,15 @@
 // 0 means no time out
 #define FRAME_TIME_OUT 10
 #define MAX_FRAME_SIZE 65536
+#define DEV_MAX_TX_FAILURES 8
+// a device marked down is probed with a frame every interval (second)
+#define DEV_PROBE_INTERVAL 1
+// max number of transmit queues of a device
+#define DEV_TX_QUEUES 4
+// max number of frames received in a batch
+#define RX_BATCH_SIZE 32
+// larger frames are not batched
+#define RX_SLOT_SIZE 2048
 
 /**
  * @brief Pcap arguments
@@ -45,6 +55,7 @@ struct PcapArgs {
   DeviceId id;
   std::string name;
   u_char mac[ETHER_ADDR_LEN];
+  int tsScale = 1000;  // ns in a unit of the fraction of capture timestamps
 
   PcapArgs(DeviceId id, std::string name, u_char *m) : id(id), name(name) {
     memcpy(mac, m, ETHER_ADDR_LEN);
@@ -53,6 +64,44 @@ struct PcapArgs {
 
 namespace Device {
 
+/**
+ * @brief A transmit queue of a device, with its own pcap handle and sending
+ * thread. Each sending thread always uses the same queue, so threads on
+ * different cores never share a lock on the transmit path.
+ *
+ */
+struct alignas(64) TxQueue {
+  std::queue<Ether::EtherFrame> frames;  // frame queue to send
+  std::mutex m;
+  std::condition_variable cv;
+  pcap_t *pcap = nullptr;
+  std::thread thread;
+};
+
+/**
+ * @brief A frame to send whose payload is in pieces, used to queue frames in
+ * a batch.
+ *
+ */
+struct FrameRef {
+  const ether_header *hdr;
+  const iovec *iov;
+  int iovcnt;
+};
+
+/**
+ * @brief Frames received in a batch, copied out of the pcap buffer.
+ *
+ */
+struct RxBatch {
+  DeviceId id;
+  frameBatchReceiveCallback cb = nullptr;  // loaded once for a dispatch
+  int tsScale = 1000;  // ns in a unit of the fraction of capture timestamps
+  int cnt = 0;
+  RxFrame frames[RX_BATCH_SIZE];
+  alignas(64) u_char slots[RX_BATCH_SIZE][RX_SLOT_SIZE];
+};
+
 /**
  * @brief Device created by addDevice
  *
@@ -65,13 +114,7 @@ class Device {
    */
   std::thread sniffingThread;
 
-  /**
-   * @brief thread sending
-   *
-   */
-  std::thread sendingThread;
-
-  ~Device();
+  virtual ~Device();
 
   /**
    * @brief Construct a new Device object
@@ -102,6 +145,13 @@ class Device {
    */
   void getMAC(u_char *dst_mac);
 
+  /**
+   * @brief Get the packed MAC address
+   *
+   * @return const MAC::MacAddr& MAC address
+   */
+  const MAC::MacAddr &getMacAddr() { return mac; }
+
   /**
    * @brief Get the MAC address (Not Recommand!)
    *
@@ -123,13 +173,91 @@ class Device {
    */
   ip_addr getSubnetMask();
 
+  /**
+   * @brief Get the MTU, the max length of an IP packet on the device
+   *
+   * @return int MTU
+   */
+  int getMtu() { return mtu; }
+
   /**
    * @brief Send a frame on the device
    *
    * @param frame the frame will be sent
    * @return int 0 on success, -1 on error
    */
-  int sendFrame(Ether::EtherFrame &frame);
+  virtual int sendFrame(Ether::EtherFrame &frame);
+
+  /**
+   * @brief Send a frame on the device. The frame is built in place in the
+   * transmit queue, so the payload is copied only once.
+   *
+   * @param hdr frame header
+   * @param iov pieces of payload
+   * @param iovcnt number of pieces
+   * @return int 0 on success, -1 on error
+   */
+  virtual int sendFrame(const ether_header &hdr, const iovec *iov, int iovcnt);
+
+  /**
+   * @brief Send frames on the device. All of them are queued in one transmit
+   * queue under one lock, and the sending thread is woken up once.
+   *
+   * @param frames frames to send
+   * @param n number of frames
+   * @return int 0 on success, -1 on error and none of them is sent
+   */
+  virtual int sendFrames(const FrameRef *frames, int n);
+
+  /**
+   * @brief Whether the link of device is up. A device is marked down after
+   * `DEV_MAX_TX_FAILURES` failed frames in a row, and up again after a frame
+   * is sent successfully.
+   *
+   */
+  bool isUp() { return up.load(); }
+
+  /**
+   * @brief Whether a frame should be sent on the device, which is down, to
+   * find out if the link is back. True once every `DEV_PROBE_INTERVAL`
+   * seconds for one caller only.
+   *
+   */
+  bool probeDue();
+
+  /**
+   * @brief Mark the link of device up or down
+   *
+   * @param u whether up
+   */
+  void setUp(bool u) { up.store(u); }
+
+  /**
+   * @brief Whether frames received are stamped by the adapter, whose clock is
+   * synced with the system clock. They are stamped by the kernel otherwise.
+   *
+   */
+  bool hasHwTstamp() { return hwTstamp; }
+
+  /**
+   * @brief Get the id of the bond device holding this device
+   *
+   * @return DeviceId id of master, -1 if not a member of any bond
+   */
+  DeviceId getMasterId() { return masterId; }
+
+  /**
+   * @brief Set the id of the bond device holding this device
+   *
+   * @param mid id of master, -1 to release
+   */
+  void setMasterId(DeviceId mid) { masterId = mid; }
+
+  /**
+   * @brief Whether the device is a member of a bond
+   *
+   */
+  bool isSlave() { return masterId >= 0; }
 
   /**
    * @brief start sniffing in this device
@@ -145,27 +273,43 @@ class Device {
    */
   int stopSniffing();
 
- private:
-  bool closed = false;
+ protected:
+  /**
+   * @brief Construct a virtual device without pcap, such as a bond.
+   *
+   * @param name the name of device
+   * @param m MAC address
+   * @param ip ip address
+   * @param mask subnet mask
+   */
+  Device(std::string name, const u_char *m, ip_addr ip, ip_addr mask);
 
   static DeviceId max_id;      // max id in devices
   DeviceId id;                 // unique id for deivce
   std::string name;            // name of device
-  u_char mac[ETHER_ADDR_LEN];  // mac address of device
+  MAC::MacAddr mac;            // mac address of device
   ip_addr ip;                  // ip of device
   ip_addr subnetMask;          // subnet mask of device
+  int mtu = ETHERMTU;          // max length of an IP packet
+
+  std::atomic_bool up{true};  // link state
+  std::atomic<int64_t> nextProbe{0};  // steady clock, ns
+  DeviceId masterId = -1;     // bond holding this device
+
+ private:
+  bool closed = false;
 
   pcap_t *pcap;        // a pcap struct pointer
   bool sniffing;       // is sniffing
   PcapArgs *pcapArgs;  // pcap args
+  bool hwTstamp = false;  // frames stamped by the adapter
+  int tsScale = 1000;     // ns in a unit of the fraction of capture timestamps
 
-  std::queue<Ether::EtherFrame> sender;  // frame queue to send
+  std::vector<std::unique_ptr<TxQueue>> txQueues;  // transmit queues
   void badDevice();    // delete and release id when get a bad device
-  int startSending();  // start a thread to send
+  int startSending();  // start a thread per transmit queue
 
-  std::condition_variable senderCv;
-  std::mutex sender_m;
-  void senderLoop();
+  void senderLoop(TxQueue &q);
 };
 
 using DevicePtr = std::shared_ptr<Device>;
@@ -211,8 +355,26 @@ class DeviceManager {
    */
   DevicePtr getDevicePtr(std::string name);
 
+  /**
+   * @brief Get the pointer of device according to ip. Members of a bond are
+   * skipped, the bond will be returned instead.
+   *
+   * @param _ip ip of device
+   * @return DevicePtr pointer of device
+   */
   DevicePtr getDevicePtr(const ip_addr &_ip);
 
+  /**
+   * @brief Bond several devices into a virtual device. The bond uses the ip and
+   * MAC address of the first member.
+   *
+   * @param name the name of bond
+   * @param memberNames names of members
+   * @return DeviceId id of bond, -1 on error
+   */
+  DeviceId addBondDevice(std::string name,
+                         const std::vector<std::string> &memberNames);
+
   /**
    * @brief Try to add all devices
    *
@@ -238,6 +400,16 @@ class DeviceManager {
    */
   bool haveDeviceWithIp(const ip_addr &ip);
 
+  /**
+   * @brief Whether a frame received is for me. Frames received by a member of
+   * bond are handled as received by the bond.
+   *
+   * @param id the device receiving the frame
+   * @param frame the frame
+   * @return DeviceId the device to handle the frame, -1 to ignore it
+   */
+  DeviceId acceptFrame(DeviceId id, const Ether::EtherView &frame);
+
   /**
    * @brief Send a frame
    *
@@ -256,6 +428,18 @@ class DeviceManager {
    */
   int sendFrame(DeviceId id, Ether::EtherFrame &frame);
 
+  /**
+   * @brief Send a frame whose payload is gathered from pieces
+   *
+   * @param dev Device pointer
+   * @param hdr frame header, src MAC address will be set
+   * @param iov pieces of payload
+   * @param iovcnt number of pieces
+   * @return int -1 on error
+   */
+  int sendFrame(DevicePtr dev, ether_header &hdr, const iovec *iov,
+                int iovcnt);
+
   /**
    * @brief
    *
@@ -290,8 +474,26 @@ class DeviceManager {
   int keepReceiving();
 };
 
+/**
+ * @brief Get the time the frame being handled by this thread was captured,
+ * by the adapter if the device supports it, by the kernel otherwise. Set
+ * while a frame, or the IP packet of it sent to me, is passed to callbacks.
+ *
+ * @return int64_t ns of the system clock, 0 if unknown
+ */
+int64_t rxTimestamp();
+
+/**
+ * @brief Set the capture time of the frame this thread handles from now
+ *
+ * @param ts ns of the system clock, 0 if unknown
+ */
+void setRxTimestamp(int64_t ts);
+
 extern DeviceManager deviceMgr;
 extern frameReceiveCallback callback;
+// batch mode if set, changed while devices are sniffing
+extern std::atomic<frameBatchReceiveCallback> batchCallback;
 }  // namespace Device
 
 /**
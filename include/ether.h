@@ -12,6 +12,7 @@
 #define ETHER_H_
 
 #include <netinet/ip.h>
+#include <sys/uio.h>
 
 #include <cstdint>
 #include <cstring>
@@ -34,24 +35,55 @@ constexpr int e_PRINT_ALL = 127;
 
 namespace MAC {
 
+// broadcast address as stored in `MacAddr::val`
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+constexpr uint64_t BROADCAST_VAL = 0x0000ffffffffffffULL;
+#else
+constexpr uint64_t BROADCAST_VAL = 0xffffffffffff0000ULL;
+#endif
+
 /**
- * @brief A class storing a MAC address
+ * @brief Load a MAC address into the low 48 bits (in memory order) of an
+ * integer, the other bytes are zero.
+ *
+ * @param mac MAC address
+ * @return uint64_t packed MAC address
+ */
+inline uint64_t load(const u_char* mac) {
+  uint64_t v = 0;
+  memcpy(&v, mac, ETHER_ADDR_LEN);
+  return v;
+}
+
+/**
+ * @brief A class storing a MAC address, packed in a 64-bit integer so that
+ * comparing and hashing are single instructions.
  *
  */
 class MacAddr {
  public:
-  u_char addr[6];
+  union {
+    u_char addr[8];  // MAC address, the last two bytes are always zero
+    uint64_t val;
+  };
 
-  MacAddr() {
-    for (int i = 0; i < 6; ++i) addr[i] = 255;
-  }
-  MacAddr(const u_char* _mac) { memcpy(addr, _mac, ETHER_ADDR_LEN); }
+  MacAddr() : val(BROADCAST_VAL) {}
+  MacAddr(const u_char* _mac) : val(load(_mac)) {}
 
-  const MacAddr& operator=(const MacAddr& m);
+  bool isBroadcast() const { return val == BROADCAST_VAL; }
+  bool isMulticast() const { return addr[0] & 1; }
 };
 
-bool operator==(const MacAddr& ml, const MacAddr& mr);
-bool isSameMacAddr(const u_char* macA, const u_char* macB);
+inline bool operator==(const MacAddr& ml, const MacAddr& mr) {
+  return ml.val == mr.val;
+}
+inline bool operator!=(const MacAddr& ml, const MacAddr& mr) {
+  return ml.val != mr.val;
+}
+
+inline bool isSameMacAddr(const u_char* macA, const u_char* macB) {
+  return load(macA) == load(macB);
+}
 
 /**
  * @brief Whether a mac address is broadcast
@@ -60,7 +92,9 @@ bool isSameMacAddr(const u_char* macA, const u_char* macB);
  * @return true is broadcast
  * @return false is not broadcast
  */
-bool isBroadcast(const u_char* mac);
+inline bool isBroadcast(const u_char* mac) {
+  return load(mac) == BROADCAST_VAL;
+}
 
 /**
  * @brief Whether a mac address is broadcast
@@ -69,7 +103,27 @@ bool isBroadcast(const u_char* mac);
  * @return true is broadcast
  * @return false is not broadcast
  */
-bool isBroadcast(const MacAddr& mac);
+inline bool isBroadcast(const MacAddr& mac) { return mac.isBroadcast(); }
+
+/**
+ * @brief Whether a mac address is multicast (broadcast included)
+ *
+ * @param mac mac address
+ * @return true is multicast
+ * @return false is not multicast
+ */
+inline bool isMulticast(const u_char* mac) { return mac[0] & 1; }
+
+/**
+ * @brief Hash of a MAC address
+ *
+ */
+struct MacHash {
+  size_t operator()(const MacAddr& m) const {
+    uint64_t h = m.val * 0x9e3779b97f4a7c15ULL;
+    return static_cast<size_t>(h ^ (h >> 32));
+  }
+};
 
 /**
  * @brief Convert a MAC address to cpp string
@@ -89,6 +143,11 @@ void strtoMAC(u_char* mac, const char* str);
 
 }  // namespace MAC
 
+namespace std {
+template <>
+struct hash<MAC::MacAddr> : MAC::MacHash {};
+}  // namespace std
+
 namespace Ether {
 
 extern const u_char broadcastMacAddr[6];
@@ -120,6 +179,16 @@ class EtherFrame {
    */
   EtherFrame(const void* buf, int l);
 
+  /**
+   * @brief Construct a new Ether Frame object from a header and a payload
+   * gathered from pieces. Only the bytes of payload are written.
+   *
+   * @param hdr frame header
+   * @param iov pieces of payload
+   * @param iovcnt number of pieces
+   */
+  EtherFrame(const ether_header& hdr, const iovec* iov, int iovcnt);
+
   /**
    * @brief Get the Frame object
    *
@@ -202,6 +271,50 @@ class EtherFrame {
    */
   void htonType() { frame.header.ether_type = htons(frame.header.ether_type); }
 };
+
+/**
+ * @brief A non-owning view of an Ethernet frame in a receive buffer. Nothing
+ * is copied, the buffer should live longer than the view.
+ *
+ */
+class EtherView {
+ public:
+  /**
+   * @brief Construct a new Ether View object
+   *
+   * @param buf frame buffer
+   * @param l length of the buffer
+   */
+  EtherView(const void* buf, int l)
+      : buf(reinterpret_cast<const u_char*>(buf)), len(l) {}
+
+  /**
+   * @brief Whether the length of frame is valid
+   *
+   */
+  bool valid() const { return len >= ETHER_HDR_LEN && len <= ETHER_MAX_LEN; }
+
+  const u_char* dstMac() const { return buf; }
+  const u_char* srcMac() const { return buf + ETHER_ADDR_LEN; }
+
+  /**
+   * @brief Get the ether type in host order
+   *
+   */
+  u_short getType() const {
+    return static_cast<u_short>((buf[2 * ETHER_ADDR_LEN] << 8) |
+                                buf[2 * ETHER_ADDR_LEN + 1]);
+  }
+
+  const u_char* getFrame() const { return buf; }
+  int getLength() const { return len; }
+  const u_char* getPayload() const { return buf + ETHER_HDR_LEN; }
+  int getPayloadLength() const { return len - ETHER_HDR_LEN; }
+
+ private:
+  const u_char* buf;
+  int len;
+};
 }  // namespace Ether
 
 namespace Printer {
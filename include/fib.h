@@ -0,0 +1,149 @@
+/**
+ * @file fib.h
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-07
+ *
+ * @brief Forwarding information base: longest prefix match by DIR-24-8. The
+ * first 24 bits of an address index a table of 2^24 entries, prefixes longer
+ * than 24 bits are expanded into groups of 256 entries indexed by the last 8
+ * bits. A lookup takes one memory access, or two for long prefixes.
+ *
+ */
+
+#ifndef FIB_H_
+#define FIB_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// max groups of 256 entries for prefixes longer than 24 bits
+#define FIB_TBL8_GROUPS (1 << 16)
+// max id of next hops
+#define FIB_MAX_NEXTHOP ((1u << 24) - 1)
+// no route
+#define FIB_NONE 0xffffffffu
+
+namespace Fib {
+
+/**
+ * @brief A DIR-24-8 table. Each entry keeps the next hop and the length of
+ * the prefix writing it, so that prefixes are added and deleted one by one
+ * without rebuilding the table. The prefixes themselves are kept by length,
+ * to find the one covering a deleted prefix.
+ *
+ * Addresses and prefixes are in host order.
+ *
+ * Lookups may run with one writer at the same time: entries are read and
+ * written atomically, a group is filled before it is linked. A group no
+ * longer linked is reused only after `reclaim`, which the writer calls after
+ * a grace period of its readers.
+ *
+ */
+class Fib {
+ public:
+  Fib();
+  ~Fib();
+  Fib(const Fib&) = delete;
+  Fib& operator=(const Fib&) = delete;
+
+  /**
+   * @brief Add a prefix, or change the next hop of it
+   *
+   * @param prefix the prefix, bits out of it are ignored
+   * @param depth length of the prefix, 0 to 32
+   * @param nh id of the next hop, no more than `FIB_MAX_NEXTHOP`
+   * @return int 0 on success, -1 on error
+   */
+  int add(uint32_t prefix, int depth, uint32_t nh);
+
+  /**
+   * @brief Delete a prefix, addresses in it go to the prefix covering it
+   *
+   * @param prefix the prefix, bits out of it are ignored
+   * @param depth length of the prefix, 0 to 32
+   * @return int 0 on success, -1 if not found
+   */
+  int del(uint32_t prefix, int depth);
+
+  /**
+   * @brief Look up the longest prefix matching an address
+   *
+   * @param ip the address
+   * @return uint32_t id of the next hop, `FIB_NONE` if no prefix matches
+   */
+  uint32_t lookup(uint32_t ip) const {
+    uint32_t e = __atomic_load_n(&tbl24[ip >> 8], __ATOMIC_ACQUIRE);
+    if (e & EXT)
+      e = __atomic_load_n(&tbl8[(e & ~EXT) << 8 | (ip & 0xff)],
+                          __ATOMIC_RELAXED);
+    return e ? (e & NH_MASK) : FIB_NONE;
+  }
+
+  /**
+   * @brief Make groups unlinked before free to use again. Readers should not
+   * be looking up since they were unlinked.
+   *
+   */
+  void reclaim();
+
+  /**
+   * @brief Get the number of prefixes
+   *
+   * @return size_t number of prefixes
+   */
+  size_t size() const { return count; }
+
+  /**
+   * @brief Get the number of groups of 256 entries in use
+   *
+   * @return int number of groups
+   */
+  int groupsUsed() const {
+    return FIB_TBL8_GROUPS - freeGroups.size() - retiredGroups.size();
+  }
+
+ private:
+  // an entry: a group of tbl8 if EXT is set, or a next hop and its depth if
+  // VALID is set, or empty
+  static constexpr uint32_t EXT = 1u << 31;
+  static constexpr uint32_t VALID = 1u << 30;
+  static constexpr uint32_t NH_MASK = FIB_MAX_NEXTHOP;
+  static constexpr int DEPTH_SHIFT = 24;
+
+  uint32_t* tbl24;
+  uint32_t* tbl8;
+  std::vector<uint32_t> freeGroups;
+  std::vector<uint32_t> retiredGroups;  // unlinked, may be read still
+  std::unordered_map<uint32_t, uint32_t> rules[33];  // by depth
+  size_t count = 0;
+
+  static uint32_t makeEntry(uint32_t nh, int depth) {
+    return VALID | depth << DEPTH_SHIFT | nh;
+  }
+  static int entryDepth(uint32_t e) { return (e >> DEPTH_SHIFT) & 0x3f; }
+  static void store(uint32_t& t, uint32_t e) {
+    __atomic_store_n(&t, e, __ATOMIC_RELEASE);
+  }
+
+  /**
+   * @brief Write an entry over the entries of a prefix chosen by `match`
+   *
+   * @param prefix the prefix
+   * @param depth length of the prefix
+   * @param e entry to write
+   * @param match whether an old entry should be written
+   * @return int 0 on success, -1 if no group is free
+   */
+  template <typename Match>
+  int write(uint32_t prefix, int depth, uint32_t e, Match match);
+
+  int expand(uint32_t i);    // turn tbl24[i] into a group
+  void collapse(uint32_t i);  // turn the group of tbl24[i] back if possible
+};
+
+}  // namespace Fib
+
+#endif  // FIB_H_
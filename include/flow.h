@@ -0,0 +1,91 @@
+/**
+ * @file flow.h
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-02
+ *
+ * @brief Flow key and flow hash of packets, used to spread packets over
+ * several links while keeping packets of one flow in order.
+ *
+ */
+
+#ifndef FLOW_H_
+#define FLOW_H_
+
+#include <netinet/ip.h>
+
+#include "ether.h"
+#include "type.h"
+
+namespace Flow {
+
+/**
+ * @brief L3/L4 information identifying a flow. Ports are zero for protocols
+ * without ports and for fragmented packets.
+ *
+ */
+struct FlowKey {
+  in_addr_t src;
+  in_addr_t dst;
+  uint16_t sport;
+  uint16_t dport;
+  uint8_t proto;
+};
+
+/**
+ * @brief Get the flow key of an IP packet in network order
+ *
+ * @param buf pointer to the IP header
+ * @param len length of the buffer
+ * @param key flow key will be stored in
+ * @return true on success, false if the buffer is not a valid IPv4 packet
+ */
+bool getFlowKey(const void* buf, int len, FlowKey& key);
+
+/**
+ * @brief Hash a flow key
+ *
+ * @param key flow key
+ * @return uint32_t hash value
+ */
+uint32_t hash(const FlowKey& key);
+
+/**
+ * @brief Hash a flow key, the same for both directions of a flow
+ *
+ * @param key flow key
+ * @return uint32_t hash value
+ */
+uint32_t symmetricHash(const FlowKey& key);
+
+/**
+ * @brief Hash a frame: flow hash for IP frames, MAC hash for others
+ *
+ * @param frame frame with ether type in host order
+ * @return uint32_t hash value
+ */
+uint32_t hash(const Ether::EtherFrame& frame);
+
+/**
+ * @brief Hash a frame whose payload is in pieces, same as the one above
+ *
+ * @param hdr frame header with ether type in host order
+ * @param iov pieces of payload
+ * @param iovcnt number of pieces
+ * @return uint32_t hash value
+ */
+uint32_t hash(const ether_header& hdr, const iovec* iov, int iovcnt);
+
+/**
+ * @brief Score of a choice for a flow in rendezvous hashing: a flow takes the
+ * choice of the highest score, so a choice leaving moves its own flows only
+ *
+ * @param flowHash flow hash
+ * @param key key of the choice, unique among the choices
+ * @return uint64_t score
+ */
+uint64_t rendezvous(uint32_t flowHash, uint64_t key);
+
+}  // namespace Flow
+
+#endif  // FLOW_H_
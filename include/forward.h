@@ -0,0 +1,159 @@
+/**
+ * @file forward.h
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-07
+ *
+ * @brief Multi-core forwarding: packets to forward are spread over several
+ * worker threads by a symmetric flow hash, so that packets of a flow are
+ * forwarded in order by one worker.
+ *
+ */
+
+#ifndef FORWARD_H_
+#define FORWARD_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "device.h"
+#include "flow.h"
+#include "ip.h"
+
+// max number of forwarding workers
+#define FWD_MAX_WORKERS 16
+// max number of threads submitting packets, such as sniffing threads
+#define FWD_MAX_PRODUCERS 8
+// slots of a ring, should be a power of 2
+#define FWD_RING_SIZE 256
+// max packets taken from a ring before turning to the next one
+#define FWD_BURST 32
+// an idle worker checks its rings after it (millisecond) at least
+#define FWD_IDLE_WAIT 1
+
+namespace Forward {
+
+/**
+ * @brief Ring buffer with a single producer and a single consumer, neither of
+ * them takes a lock. Slots are written and read in place.
+ *
+ * @tparam T type of slots
+ * @tparam N number of slots, a power of 2
+ */
+template <typename T, size_t N>
+class SpscRing {
+  static_assert((N & (N - 1)) == 0, "size of ring should be a power of 2");
+
+ public:
+  /**
+   * @brief Get the free slot to write, then `push` it (producer only)
+   *
+   * @return T* the slot, nullptr if the ring is full
+   */
+  T* back() {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head.load(std::memory_order_acquire) == N) return nullptr;
+    return &slots[t & (N - 1)];
+  }
+
+  void push() { tail.store(tail.load() + 1, std::memory_order_release); }
+
+  /**
+   * @brief Get the oldest slot to read, then `pop` it (consumer only)
+   *
+   * @return T* the slot, nullptr if the ring is empty
+   */
+  T* front() {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) return nullptr;
+    return &slots[h & (N - 1)];
+  }
+
+  void pop() { head.store(head.load() + 1, std::memory_order_release); }
+
+ private:
+  alignas(64) std::atomic<size_t> head{0};
+  alignas(64) std::atomic<size_t> tail{0};
+  alignas(64) T slots[N];
+};
+
+/**
+ * @brief A packet copied out of the receive buffer
+ *
+ */
+struct Slot {
+  int len;
+  u_char data[RX_SLOT_SIZE];
+};
+
+using Ring = SpscRing<Slot, FWD_RING_SIZE>;
+
+/**
+ * @brief Forwarding workers. Each worker owns one ring per producer thread, a
+ * producer hashes the packet to a worker and copies it into its ring. Routing
+ * table and ARP table are read by workers without locking.
+ *
+ */
+class ForwardEngine {
+ public:
+  ~ForwardEngine();
+
+  /**
+   * @brief Start workers
+   *
+   * @param n number of workers, at most `FWD_MAX_WORKERS`
+   * @return int 0 on success, -1 on error
+   */
+  int start(int n);
+
+  /**
+   * @brief Stop all workers, packets queued are forwarded before
+   *
+   */
+  void stop();
+
+  bool running() const { return run; }
+
+  /**
+   * @brief Queue a packet to be forwarded by a worker. The packet is dropped
+   * and counted if the ring of the worker is full.
+   *
+   * @param ipv the packet
+   * @return int 0 if queued or dropped, -1 on error
+   */
+  int submit(const Ip::IpView& ipv);
+
+  /**
+   * @brief Get the number of packets dropped as rings were full
+   *
+   * @return uint64_t packets dropped
+   */
+  uint64_t getDropped() const { return dropped; }
+
+ private:
+  struct Worker {
+    std::thread thread;
+    std::atomic<Ring*> rings[FWD_MAX_PRODUCERS] = {};  // one per producer
+    std::mutex m;
+    std::condition_variable cv;
+    std::atomic<bool> sleeping{false};
+  };
+
+  Worker workers[FWD_MAX_WORKERS];
+  int workerCnt = 0;
+  std::atomic<bool> run{false};
+  std::atomic<int> producerCnt{0};
+  std::atomic<uint64_t> dropped{0};
+
+  int getProducer();
+  void workerLoop(Worker& w);
+};
+
+extern ForwardEngine engine;
+
+}  // namespace Forward
+
+#endif  // FORWARD_H_
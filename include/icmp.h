@@ -0,0 +1,104 @@
+/**
+ * @file icmp.h
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-06
+ *
+ * @brief Library supporting sending and receiving ICMP messages.
+ *
+ */
+
+#ifndef ICMP_H_
+#define ICMP_H_
+
+#include <netinet/ip_icmp.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "ip.h"
+#include "pmtu.h"
+
+// default bytes of data in an echo request, same as ping
+#define ICMP_PROBE_DATA 56
+
+namespace Icmp {
+
+/**
+ * @brief RTT statistics of a probe, in millisecond
+ *
+ */
+struct ProbeStats {
+  int sent = 0;
+  int received = 0;
+  double min = 0;
+  double avg = 0;
+  double max = 0;
+  double p50 = 0;
+  double p90 = 0;
+  double p99 = 0;
+  bool hwTstamp = false;  // replies were stamped by the adapter
+};
+
+/**
+ * @brief Callback for ICMP packets sent to me.
+ *
+ * Echo requests are answered by reflecting the message: only the type and
+ * the checksum are changed, the data is sent from the packet received.
+ * Echo replies are taken by the running probe. Fragmentation Needed
+ * (type 3 code 4) updates the path MTU of the original destination.
+ *
+ * @param buf the IP packet, in network order
+ * @param len length
+ * @return int 0 on success, -1 on error
+ */
+int icmpCallBack(const void* buf, int len);
+
+/**
+ * @brief Tell the source of a packet that it is too large and DF is set
+ * (type 3 code 4).
+ *
+ * @param ipv the packet dropped
+ * @param mtu MTU of the next hop
+ * @return int 0 on success, -1 on error
+ */
+int sendFragNeeded(const Ip::IpView& ipv, int mtu);
+
+/**
+ * @brief Send echo requests to a host and collect round trip times. Only one
+ * probe runs at a time, others wait for it.
+ *
+ * A request carries the time it is sent by the system clock. A reply is
+ * timed by the capture timestamp of its frame: by the adapter if the device
+ * supports it (`Device::hasHwTstamp`), by the kernel otherwise, or when the
+ * ICMP layer sees it if the frame is not stamped. The sending time is always
+ * taken by software, before the request is queued.
+ *
+ * @param dst host to probe
+ * @param count number of requests
+ * @param stats statistics will be stored in
+ * @param size bytes of data in a request, at least 8
+ * @param interval interval between requests (millisecond)
+ * @param timeout time to wait for replies after the last request (millisecond)
+ * @return int number of replies received, -1 on error
+ */
+int probe(const ip_addr& dst, int count, ProbeStats& stats,
+          int size = ICMP_PROBE_DATA, int interval = 1000, int timeout = 1000);
+
+}  // namespace Icmp
+
+namespace Printer {
+
+/**
+ * @brief Print statistics of a probe
+ *
+ * @param dst host probed
+ * @param stats statistics
+ */
+void printProbeStats(const ip_addr& dst, const Icmp::ProbeStats& stats);
+
+}  // namespace Printer
+
+#endif  // ICMP_H_
@@ -14,11 +14,17 @@
 
 #include <netinet/ip.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <chrono>
 
 #include "arp.h"
 #include "router.h"
 #include "type.h"
 
+// max pieces of payload in an IP packet to send
+#define IP_MAX_IOV 16
+
 namespace Ip {
 
 /**
@@ -28,21 +34,21 @@ namespace Ip {
 constexpr int IGNORE = 0;
 
 /**
- * @brief An IP packet
+ * @brief An IP packet to send: a header and pieces of payload. The payload is
+ * not copied, its buffers should live until the packet is sent.
  *
  */
 class IpPacket {
  public:
-  struct __attribute__((__packed__)) {
-    ip hdr;
-    u_char data[IP_MAXPACKET];
-  };
+  ip hdr;
+  iovec iov[IP_MAX_IOV];  // pieces of payload
+  int iovcnt = 0;
 
   IpPacket() { setDefaultHdr(); };
-  IpPacket(const u_char* buf, int len);
 
   void setDefaultHdr();
   int setData(const u_char* buf, int len);
+  int setData(const iovec* v, int cnt);
 
   // use this after hton
   void setChksum();
@@ -68,7 +74,70 @@ class IpPacket {
 };
 
 /**
- * @brief Send an IP packet
+ * @brief A non-owning, bounds-checked view of an IP packet in network order.
+ * Nothing is copied, the buffer should live longer than the view.
+ *
+ */
+class IpView {
+ public:
+  /**
+   * @brief Construct a new Ip View object
+   *
+   * @param buf packet buffer
+   * @param len length of the buffer
+   */
+  IpView(const void* buf, int len)
+      : buf(reinterpret_cast<const u_char*>(buf)), len(len) {}
+
+  /**
+   * @brief Whether the packet is a valid IPv4 packet inside the buffer
+   *
+   */
+  bool valid() const {
+    if (len < static_cast<int>(sizeof(ip))) return false;
+    int hl = getHeaderLength(), tl = getTotalLength();
+    return (buf[0] >> 4) == 4 && hl >= static_cast<int>(sizeof(ip)) &&
+           tl >= hl && tl <= len;
+  }
+
+  int getHeaderLength() const { return (buf[0] & 0xf) * 4; }
+  int getTotalLength() const { return (buf[2] << 8) | buf[3]; }
+  uint16_t getId() const { return (buf[4] << 8) | buf[5]; }
+  uint16_t getOff() const { return (buf[6] << 8) | buf[7]; }
+  uint8_t getTtl() const { return buf[8]; }
+  uint8_t getProto() const { return buf[9]; }
+
+  ip_addr getSrc() const {
+    ip_addr a;
+    memcpy(&a, buf + 12, sizeof(ip_addr));
+    return a;
+  }
+
+  ip_addr getDst() const {
+    ip_addr a;
+    memcpy(&a, buf + 16, sizeof(ip_addr));
+    return a;
+  }
+
+  const u_char* getPacket() const { return buf; }
+  const u_char* getPayload() const { return buf + getHeaderLength(); }
+  int getPayloadLength() const { return getTotalLength() - getHeaderLength(); }
+
+  /**
+   * @brief Check Checksum of header
+   *
+   * @return true on right, false on error
+   */
+  bool chkChksum() const;
+
+ private:
+  const u_char* buf;
+  int len;
+};
+
+/**
+ * @brief Send an IP packet. Packets larger than the path MTU are sent in
+ * fragments, others are sent with DF set.
  *
  * @param src src IP
  * @param dest dst IP
@@ -81,7 +150,82 @@ int sendIPPacket(const ip_addr src, const ip_addr dest, int proto,
                  const void* buf, int len);
 
 /**
- * @brief Get the Checksum of a buffer. Will be used in TCP as well
+ * @brief Send an IP packet whose payload is in pieces, such as a header of
+ * the protocol above and its data. The payload is copied only once, into the
+ * frame to send.
+ *
+ * @param src src IP
+ * @param dest dst IP
+ * @param proto protocol. such as TCP
+ * @param iov pieces of payload
+ * @param iovcnt number of pieces, no more than `IP_MAX_IOV`
+ * @return int result
+ */
+int sendIPPacket(const ip_addr src, const ip_addr dest, int proto,
+                 const iovec* iov, int iovcnt);
+
+/**
+ * @brief The destination of a connection resolved once: egress device, MAC
+ * of the next hop and path MTU. It is valid as long as `Route::generation`
+ * does not change and the path MTU learnt does not expire, so packets of the
+ * connection skip the lookups of device, route and ARP. A cache should be
+ * used by one thread only.
+ *
+ */
+struct DstCache {
+  uint64_t gen = 0;  // 0 for empty
+  ip_addr src;
+  ip_addr dst;
+  Device::DevicePtr dev;
+  MAC::MacAddr mac;
+  int mtu;
+  std::chrono::steady_clock::time_point mtuExpire;  // path MTU learnt expires
+};
+
+/**
+ * @brief Send an IP packet through a destination cache, which is filled on
+ * the first packet and again after routes or neighbors change. A neighbor not
+ * resolved yet is not cached.
+ *
+ * @param cache destination cache of the sender
+ * @param src src IP
+ * @param dest dst IP
+ * @param proto protocol. such as TCP
+ * @param iov pieces of payload
+ * @param iovcnt number of pieces, no more than `IP_MAX_IOV`
+ * @return int result
+ */
+int sendIPPacket(DstCache& cache, const ip_addr src, const ip_addr dest,
+                 int proto, const iovec* iov, int iovcnt);
+
+/**
+ * @brief An IP packet to send in a batch by `sendIPPackets`
+ *
+ */
+struct Packet {
+  ip_addr src;
+  ip_addr dst;
+  int proto;
+  const void* buf;  // payload
+  int len;
+};
+
+/**
+ * @brief Send IP packets in a batch. Packets are grouped by flow, hashed as
+ * `sendIPPacket` does: the next hop of a group is resolved once, and the
+ * frames to a device are queued in one operation. Packets of a flow leave in
+ * order through the same next hop as by `sendIPPacket`. Packets to a neighbor
+ * not resolved yet wait for ARP as `sendIPPacket` does.
+ *
+ * @param packets packets to send
+ * @param n number of packets
+ * @return int number of packets sent
+ */
+int sendIPPackets(const Packet* packets, size_t n);
+
+/**
+ * @brief Get the Checksum of a buffer. Will be used in TCP as well. The
+ * fastest kernel in `Checksum` is used.
  *
  * @param vdata buffer point
  * @param length length
@@ -89,11 +233,69 @@ int sendIPPacket(const ip_addr src, const ip_addr dest, int proto,
  */
 uint16_t getChecksum(const void* vdata, size_t length);
 
+/**
+ * @brief Combine checksums of two adjacent buffers, so that the checksum of
+ * pseudo header and payload can be got without copying them together.
+ *
+ * @param a checksum of the first buffer, whose length should be even
+ * @param b checksum of the second buffer
+ * @return uint16_t checksum of both buffers
+ */
+uint16_t combineChecksum(uint16_t a, uint16_t b);
+
+/**
+ * @brief Update a checksum incrementally after a 16-bit word of the buffer
+ * changed (RFC 1624). Byte order does not matter as long as all arguments are
+ * in the same order as stored.
+ *
+ * @param sum old checksum
+ * @param oldWord old value of the word
+ * @param newWord new value of the word
+ * @return uint16_t new checksum
+ */
+uint16_t updateChecksum(uint16_t sum, uint16_t oldWord, uint16_t newWord);
+
+/**
+ * @brief Forward a packet not sent to me. TTL is decremented and the checksum
+ * is patched incrementally, the header is never converted to host order.
+ * Packets whose TTL would reach zero are dropped. Packets too large for the
+ * next hop are fragmented, or dropped with an ICMP Fragmentation Needed if DF
+ * is set.
+ *
+ * Decisions are cached per flow in a small direct-mapped cache of each thread,
+ * holding the egress device and the frame header. Entries are dropped when
+ * `Route::generation` changes.
+ *
+ * @param ipv the packet
+ * @return int 0 on success or dropped, -1 on error
+ */
+int forwardPacket(const IpView& ipv);
+
+/**
+ * @brief Forward a packet with the route already looked up
+ *
+ * @param ipv the packet
+ * @param ri route to the destination
+ * @return int 0 on success or dropped, -1 on error
+ */
+int forwardPacket(const IpView& ipv, const Route::RouteItem& ri);
+
+/**
+ * @brief Submit a packet sent to me to the protocol above. Fragments are held
+ * until the whole datagram is reassembled.
+ *
+ * @param ipv the packet
+ * @return int result of the protocol above
+ */
+int deliverPacket(const IpView& ipv);
+
 /**
  * @brief Common IP packet callback.
  *
  * It is necessary to check or forward a packet in this function. Then it will
- * submit to `callback` below
+ * submit to `callback` below, with the packet still in network order.
+ * Fragments are submitted once the whole datagram is reassembled. ICMP
+ * packets are handled by `Icmp::icmpCallBack` instead.
  *
  * @param buf buffer
  * @param len length
@@ -103,11 +305,21 @@ uint16_t getChecksum(const void* vdata, size_t length);
 int ipCallBack(const void* buf, int len, DeviceId id);
 
 /**
- * @brief The specific callback for IP packet
+ * @brief The callback for IP packets sent to me whose protocol has no
+ * callback registered
  *
  */
 extern IPPacketReceiveCallback callback;
 
+/**
+ * @brief Register a callback for IP packets sent to me with a protocol
+ *
+ * @param proto value of `protocol` field in IP header
+ * @param callback the callback, nullptr to remove
+ * @return int 0 on success, -1 on error
+ */
+int setProtocolCallback(uint8_t proto, IPPacketReceiveCallback callback);
+
 /**
  * @brief Get a string from an `in_addr` ip address
  *
@@ -149,6 +361,14 @@ void printIp(const ip_addr& ip, bool newline = true);
  * @param sender whether it's the sender
  */
 void printIpPacket(const Ip::IpPacket& ipp, bool sender = false);
+
+/**
+ * @brief Print an ip packet in network order
+ *
+ * @param ipv ip packet view
+ * @param sender whether it's the sender
+ */
+void printIpPacket(const Ip::IpView& ipv, bool sender = false);
 }  // namespace Printer
 
 /*
@@ -0,0 +1,119 @@
+/**
+ * @file ipfrag.h
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-05
+ *
+ * @brief Reassembly of IP fragments.
+ *
+ */
+
+#ifndef IPFRAG_H_
+#define IPFRAG_H_
+
+#include <chrono>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "ip.h"
+
+// time to wait for all fragments of a datagram (second)
+#define IPFRAG_TIME_OUT 30
+// max bytes held by all incomplete datagrams
+#define IPFRAG_MEM_LIMIT (4 * 1024 * 1024)
+// bytes charged for a datagram besides its data: the entry, the node of the
+// list and the header
+#define IPFRAG_DATAGRAM_COST 256
+// bytes charged for a piece of data besides itself: the node and the vector
+#define IPFRAG_PIECE_COST 64
+
+namespace IpFrag {
+
+/**
+ * @brief Fragments with the same key belong to one datagram (RFC 791)
+ *
+ */
+struct FragKey {
+  in_addr_t src;
+  in_addr_t dst;
+  uint16_t id;
+  uint8_t proto;
+};
+
+inline bool operator==(const FragKey& a, const FragKey& b) {
+  return a.src == b.src && a.dst == b.dst && a.id == b.id &&
+         a.proto == b.proto;
+}
+
+struct FragKeyHash {
+  size_t operator()(const FragKey& k) const {
+    uint64_t h = (static_cast<uint64_t>(k.src) << 32) ^ k.dst;
+    h ^= (static_cast<uint64_t>(k.id) << 8 | k.proto) * 0x9e3779b97f4a7c15ULL;
+    h *= 0xff51afd7ed558ccdULL;
+    return static_cast<size_t>(h ^ (h >> 32));
+  }
+};
+
+/**
+ * @brief Reassemble fragments into datagrams.
+ *
+ * Incomplete datagrams are kept in a hash table, and dropped after
+ * `IPFRAG_TIME_OUT` seconds. Each datagram and each piece of data is charged
+ * its data and a fixed overhead, when the bytes charged would exceed
+ * `IPFRAG_MEM_LIMIT`, the oldest datagrams are dropped first. Overlapping
+ * fragments are trimmed, bytes received first are kept. Fragments without
+ * data are dropped.
+ *
+ */
+class Reassembler {
+ public:
+  /**
+   * @brief Add a fragment
+   *
+   * @param ipv a fragment
+   * @param packet the whole datagram in network order will be stored in, if
+   * it is completed by this fragment
+   * @return int 1 if the datagram is completed, 0 if waiting for more
+   * fragments, -1 if the fragment is dropped
+   */
+  int insert(const Ip::IpView& ipv, std::vector<u_char>& packet);
+
+  /**
+   * @brief Get the bytes charged for incomplete datagrams
+   *
+   * @return size_t bytes charged
+   */
+  size_t getMemUsed();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Datagram {
+    std::map<int, std::vector<u_char>> pieces;  // offset -> data
+    std::vector<u_char> hdr;       // header of the first fragment
+    int totalLen = -1;             // length of data, -1 before last fragment
+    int recvLen = 0;               // bytes of data received
+    size_t mem = 0;                // bytes charged
+    Clock::time_point expire;      // drop if not completed before it
+    std::list<FragKey>::iterator order;
+  };
+
+  std::unordered_map<FragKey, Datagram, FragKeyHash> datagrams;
+  std::list<FragKey> order;  // keys from the oldest to the newest
+  size_t memUsed = 0;
+  std::mutex m;
+
+  void drop(const FragKey& key);
+  void expire(Clock::time_point now);
+  int addPiece(Datagram& dg, int off, const u_char* data, int len);
+  void build(const Datagram& dg, std::vector<u_char>& packet);
+};
+
+extern Reassembler reassembler;
+
+}  // namespace IpFrag
+
+#endif  // IPFRAG_H_
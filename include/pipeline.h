@@ -0,0 +1,46 @@
+/**
+ * @file pipeline.h
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-07
+ *
+ * @brief Vector processing of received frames: a batch of frames goes through
+ * each stage in turn, instead of one frame through all stages.
+ *
+ */
+
+#ifndef PIPELINE_H_
+#define PIPELINE_H_
+
+#include "device.h"
+#include "forward.h"
+#include "ip.h"
+#include "policer.h"
+
+namespace Pipeline {
+
+/**
+ * @brief Process a batch of frames. Stages are
+ *
+ * 1. L2 classify: drop frames not for me, IPv4 frames go on, others are
+ *    handled by `Device::callback` one by one.
+ * 2. IP validate: check the header, police it, and check its checksum.
+ * 3. Local or forward: split packets sent to me and packets to forward.
+ * 4. Forward: packet by packet through `Ip::forwardPacket`, whose flow cache
+ *    skips the route lookup, or queued to `Forward::engine` if it is running.
+ *    Routes are not looked up in a stage of their own.
+ * 5. L4 demux: submit packets sent to me to the protocol above.
+ *
+ * A frame other than IPv4 ends a vector: IP packets before it go through
+ * stages 2 to 5 before it is handled, so it never overtakes them. Each stage
+ * prefetches the headers of the next packet.
+ *
+ * @param frames frames received
+ * @param n number of frames
+ * @return int 0 on success, -1 if any frame failed
+ */
+int processBatch(const RxFrame* frames, int n);
+
+}  // namespace Pipeline
+
+#endif  // PIPELINE_H_
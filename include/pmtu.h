@@ -0,0 +1,74 @@
+/**
+ * @file pmtu.h
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-06
+ *
+ * @brief Path MTU discovery (RFC 1191): a cache of path MTU per destination,
+ * fed by ICMP Fragmentation Needed messages.
+ *
+ */
+
+#ifndef PMTU_H_
+#define PMTU_H_
+
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+
+#include "type.h"
+
+// a learnt path MTU is forgotten after it (second), RFC 1191 suggests 10 min
+#define PMTU_TIME_OUT 600
+// the smallest MTU every host should accept (RFC 791)
+#define PMTU_MIN 68
+
+namespace Pmtu {
+
+/**
+ * @brief Path MTU of destinations. Only smaller MTUs are learnt, entries
+ * expire after `PMTU_TIME_OUT` seconds, so that a larger MTU may be probed
+ * again.
+ *
+ */
+class PmtuCache {
+ public:
+  /**
+   * @brief Get the path MTU to a destination
+   *
+   * @param dst destination
+   * @param devMtu MTU of device sending the packet
+   * @param expire (optional) when the MTU returned expires, the max time if
+   * it is the MTU of device
+   * @return int path MTU, no larger than devMtu
+   */
+  int get(const ip_addr& dst, int devMtu,
+          std::chrono::steady_clock::time_point* expire = nullptr);
+
+  /**
+   * @brief Learn a path MTU from an ICMP Fragmentation Needed message
+   *
+   * @param dst destination of the packet that was too large
+   * @param mtu MTU of the next hop, 0 if the router does not tell it
+   * @param packLen length of the packet that was too large
+   * @return int the new path MTU
+   */
+  int update(const ip_addr& dst, int mtu, int packLen);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Entry {
+    int mtu;
+    Clock::time_point expire;
+  };
+
+  std::unordered_map<ip_addr, Entry, IpHash> entries;
+  std::mutex m;
+};
+
+extern PmtuCache pmtuCache;
+
+}  // namespace Pmtu
+
+#endif  // PMTU_H_
@@ -0,0 +1,164 @@
+/**
+ * @file policer.h
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-07
+ *
+ * @brief Ingress policers: token buckets per class of traffic and per source,
+ * checked before any expensive work on a frame, so that a flood is dropped
+ * cheaply on the receiving thread.
+ *
+ */
+
+#ifndef POLICER_H_
+#define POLICER_H_
+
+#include <atomic>
+
+#include "ip.h"
+#include "type.h"
+
+// buckets of sources of each class, should be a power of 2
+#define POLICER_SOURCES 4096
+
+namespace Policer {
+
+/**
+ * @brief Classes of traffic policed separately. SYN is apart from other TCP
+ * segments, so that a SYN flood never slows down connections established.
+ *
+ */
+enum class Class : int {
+  ARP = 0,
+  ICMP,
+  TCP_SYN,
+  TCP,
+  UDP,
+  OTHER,
+  COUNT
+};
+
+/**
+ * @brief Counters of a class
+ *
+ */
+struct Counters {
+  uint64_t passed;
+  uint64_t droppedByClass;   // over the rate of the whole class
+  uint64_t droppedBySource;  // over the rate of a single source
+};
+
+/**
+ * @brief Token buckets of all classes. A bucket is kept as the theoretical
+ * arrival time of the next packet (GCRA), so it is checked and updated by one
+ * compare-and-swap, no lock is taken. A rate of zero means no limit, which is
+ * the default of every class.
+ *
+ */
+class Policer {
+ public:
+  /**
+   * @brief Set the rate of a whole class
+   *
+   * @param c the class
+   * @param rate packets per second, 0 for no limit
+   * @param burst packets allowed at once above the rate
+   * @return int 0 on success, -1 on error
+   */
+  int setClassRate(Class c, uint32_t rate, uint32_t burst);
+
+  /**
+   * @brief Set the rate of every single source in a class. Sources are hashed
+   * into `POLICER_SOURCES` buckets, a source taking the bucket of another one
+   * starts with a full bucket. So sources are not remembered: a flood from
+   * sources changing all the time, such as spoofed ones, gets a full bucket
+   * for each of them, only the rate of the class stops it.
+   *
+   * @param c the class
+   * @param rate packets per second, 0 for no limit
+   * @param burst packets allowed at once above the rate
+   * @return int 0 on success, -1 on error
+   */
+  int setSourceRate(Class c, uint32_t rate, uint32_t burst);
+
+  /**
+   * @brief Check a packet and take a token. The bucket of the source is
+   * checked first, so a single noisy source cannot use up the class.
+   *
+   * @param c class of the packet
+   * @param source key of the source, such as an IP address
+   * @return true to accept, false to drop
+   */
+  bool admit(Class c, uint32_t source);
+
+  /**
+   * @brief Check an ARP packet, by the sender hardware address. Packets too
+   * short to hold one share the source 0.
+   *
+   * @param frame the frame
+   * @return true to accept, false to drop
+   */
+  bool admitArp(const Ether::EtherView& frame);
+
+  /**
+   * @brief Check an IP packet, by its protocol and source address
+   *
+   * @param ipv the packet, should be valid
+   * @return true to accept, false to drop
+   */
+  bool admitIp(const Ip::IpView& ipv);
+
+  Counters getCounters(Class c);
+
+  void resetCounters();
+
+ private:
+  // a limit: time between tokens and time a burst takes, in nanoseconds
+  struct Limit {
+    std::atomic<uint64_t> interval{0};
+    std::atomic<uint64_t> tolerance{0};
+  };
+
+  struct SourceBucket {
+    std::atomic<uint32_t> source{0};
+    std::atomic<uint64_t> tat{0};
+  };
+
+  struct ClassState {
+    Limit classLimit, sourceLimit;
+    std::atomic<uint64_t> tat{0};
+    SourceBucket sources[POLICER_SOURCES];
+    std::atomic<uint64_t> passed{0};
+    std::atomic<uint64_t> droppedByClass{0};
+    std::atomic<uint64_t> droppedBySource{0};
+  };
+
+  ClassState classes[static_cast<int>(Class::COUNT)];
+
+  static int setLimit(Limit& l, uint32_t rate, uint32_t burst);
+  static bool take(std::atomic<uint64_t>& tat, const Limit& l, uint64_t now);
+};
+
+extern Policer policer;
+
+/**
+ * @brief Get the name of a class
+ *
+ * @param c the class
+ * @return const char* name
+ */
+const char* className(Class c);
+
+}  // namespace Policer
+
+namespace Printer {
+
+/**
+ * @brief Print counters of all classes
+ *
+ */
+void printPolicerCounters();
+
+}  // namespace Printer
+
+#endif  // POLICER_H_
@@ -0,0 +1,82 @@
+/**
+ * @file rcu.h
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-07
+ *
+ * @brief Epoch-based reclamation for read-mostly data. Readers mark a short
+ * critical section and take no lock, a writer replaces data, waits for a
+ * grace period after which no reader can hold the old data, then frees it.
+ *
+ */
+
+#ifndef RCU_H_
+#define RCU_H_
+
+#include <atomic>
+#include <cstdint>
+
+// max threads in critical sections with a slot of their own
+#define RCU_MAX_THREADS 128
+
+namespace Rcu {
+
+/**
+ * @brief A reclamation domain. Each reading thread owns a slot holding the
+ * epoch it entered its critical section with, 0 when it is outside. A grace
+ * period waits until every slot is 0 or has a newer epoch.
+ *
+ */
+class Domain {
+ public:
+  /**
+   * @brief Enter a critical section, data read in it stays alive until
+   * `readUnlock`. Sections should be short and never nested.
+   *
+   */
+  void readLock();
+
+  void readUnlock();
+
+  /**
+   * @brief Wait for a grace period: readers in critical sections entered
+   * before the call have all left. Called by writers only, never in a
+   * critical section.
+   *
+   */
+  void synchronize();
+
+ private:
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> used{false};
+  };
+
+  std::atomic<uint64_t> epoch{1};
+  Slot slots[RCU_MAX_THREADS];
+  // readers when all slots are taken, a grace period waits for all of them
+  std::atomic<int> overflow{0};
+
+  int getSlot();  // slot of this thread, -1 if none is free
+};
+
+extern Domain domain;
+
+/**
+ * @brief A critical section of a scope
+ *
+ */
+class ReadGuard {
+ public:
+  explicit ReadGuard(Domain& d = domain) : d(d) { d.readLock(); }
+  ~ReadGuard() { d.readUnlock(); }
+  ReadGuard(const ReadGuard&) = delete;
+  ReadGuard& operator=(const ReadGuard&) = delete;
+
+ private:
+  Domain& d;
+};
+
+}  // namespace Rcu
+
+#endif  // RCU_H_
@@ -11,28 +11,73 @@
 #ifndef ROUTER_H_
 #define ROUTER_H_
 
+#include <atomic>
 #include <cstdlib>
+#include <memory>
+#include <mutex>
 #include <optional>
-#include <set>
+#include <unordered_map>
+#include <vector>
 
 #include "device.h"
+#include "fib.h"
+#include "rcu.h"
 #include "sdp.h"
 
+// max routing items in the FIB
+#define ROUTE_MAX_ITEMS (1 << 20)
+
 namespace SDP {
 int sdpCallBack(const void* buf, int len, DeviceId id);
 }
 
 namespace Route {
 
-using RoutingTable = std::set<RouteItem>;
+/**
+ * @brief Get the key of a routing item in the table
+ *
+ * @param prefix prefix, bits out of the mask are ignored
+ * @param mask subnet mask
+ * @return uint64_t the prefix in host order and its length
+ */
+uint64_t routeKey(const ip_addr& prefix, const ip_addr& mask);
 
+/**
+ * @brief Routing table keyed by `routeKey`, items with the same prefix and
+ * mask are one item.
+ *
+ */
+using RoutingTable = std::unordered_map<uint64_t, RouteItem>;
+
+/**
+ * @brief Routing table and SDP. Writers change `table` with `table_m` held,
+ * an SDP item finds its routing item by one hash probe. Readers of the whole
+ * table get an immutable snapshot, copied once after changes.
+ *
+ * Lookups go through a DIR-24-8 FIB kept in step with the table, which maps
+ * prefixes to immutable copies of routing items. Lookups take no lock: the
+ * FIB is changed in place atomically, a changed item is replaced by a new
+ * copy, and old copies are freed after a grace period of `Rcu::domain`. A
+ * writer publishes all changes of a batch and waits for one grace period.
+ *
+ */
 class Router {
  public:
-  RoutingTable table;
+  RoutingTable table;   // changed by writers only
+  std::mutex table_m;   // mutex for writers
   std::thread loopThread;
 
   /**
-   * @brief look up a routing item for ip
+   * @brief Get a snapshot of the routing table, copied if the table changed
+   * after the last one
+   *
+   * @return std::shared_ptr<const RoutingTable> the table
+   */
+  std::shared_ptr<const RoutingTable> getTable();
+
+  /**
+   * @brief look up a routing item for ip, the longest prefix matching it. It
+   * takes one or two memory accesses however large the table is.
    *
    * @param ip ip to look up
    * @return RouteItem routing item
@@ -78,11 +123,46 @@ class Router {
   void update(const SDP::SDPItemVector& sis, const MAC::MacAddr mac,
               const Device::DevicePtr dev);
 
+  /**
+   * @brief Let all routing items via a device go via another one, such as a
+   * bond holding the device.
+   *
+   * @param from old device
+   * @param to new device
+   */
+  void rebindDevice(const Device::DevicePtr& from, const Device::DevicePtr& to);
+
   void routerWorkingLoop();
+
+ private:
+  std::shared_ptr<const RoutingTable> snapshot =
+      std::make_shared<RoutingTable>();
+  bool stale = false;  // snapshot is older than table
+
+  Fib::Fib fib;  // ids of routes by prefix
+  std::unique_ptr<std::atomic<const RouteItem*>[]> routes{
+      new std::atomic<const RouteItem*>[ROUTE_MAX_ITEMS]()};  // by id
+  std::unordered_map<uint64_t, uint32_t> ids;  // ids by prefix and length
+  std::vector<uint32_t> freeIds;
+  uint32_t nextId = 0;
+  std::vector<uint64_t> changed;  // keys changed for lookups since publish
+
+  // mark an item changed for lookups: added, deleted, or its hops changed
+  void touch(uint64_t key) { changed.push_back(key); }
+  void publish();  // publish changes of `table`, with table_m held
+  void syncFib();  // apply items changed to the FIB
 };
 
 extern Router router;
 
+/**
+ * @brief Generation of forwarding state, bumped after the routing table, the
+ * ARP table or a path MTU changes. Forwarding decisions and destinations
+ * cached with an older generation are stale.
+ *
+ */
+extern std::atomic<uint64_t> generation;
+
 }  // namespace Route
 
 namespace Printer {
@@ -13,7 +13,10 @@
 #define SDP_H_
 
 #include <array>
+#include <chrono>
 #include <map>
+#include <mutex>
+#include <unordered_map>
 
 #include "device.h"
 #include "ether.h"
@@ -21,9 +24,18 @@
 #include "type.h"
 
 #define MAX_SDP_DATA_LEN 255
+// an advertisement split over frames is dropped if its last frame does not
+// come in it (second)
+#define SDP_REASSEMBLY_TIMEOUT 3
+// max items of an advertisement being collected
+#define SDP_REASSEMBLY_MAX_ITEMS (1 << 17)
+// max advertisements being collected at the same time
+#define SDP_REASSEMBLY_MAX_PENDING 256
 #define SDP_METRIC_NODEL -1  // will never be deleted from routing table
 #define SDP_METRIC_DIE -2
 #define SDP_METRIC_TIMEOUT 2
+// max equal-cost next hops of a routing item
+#define ROUTE_MAX_NEXTHOPS 8
 
 #ifndef NDEBUG
 #define ROUTE_LOOP_INTERVAL 10
@@ -40,7 +52,19 @@
 namespace Route {
 
 /**
- * @brief Routing item in routing table
+ * @brief A next hop of a routing item
+ *
+ */
+struct NextHop {
+  Device::DevicePtr dev;
+  MAC::MacAddr mac;
+  int metric;  // age of the hop, same as `RouteItem::metric`
+};
+
+/**
+ * @brief Routing item in routing table. A routing item may have several next
+ * hops of the same distance (ECMP), `dev` and `nextHopMac` are those of the
+ * first one.
  *
  */
 class RouteItem {
@@ -52,6 +76,8 @@ class RouteItem {
   mutable MAC::MacAddr nextHopMac;
   mutable int dist;
   mutable int metric;
+  mutable std::array<NextHop, ROUTE_MAX_NEXTHOPS> nextHops;
+  mutable int hopCnt = 0;
 
   RouteItem() = default;
   RouteItem(const ip_addr& _ip, const ip_addr& _mask,
@@ -66,6 +92,49 @@ class RouteItem {
    * @return false cannot
    */
   bool haveIp(const ip_addr& ip) const;
+
+  /**
+   * @brief Find a next hop
+   *
+   * @param mac MAC address of the hop
+   * @return NextHop* the hop, nullptr if not found
+   */
+  NextHop* findHop(const MAC::MacAddr& mac) const;
+
+  /**
+   * @brief Make a hop the only next hop
+   *
+   */
+  void setHop(const Device::DevicePtr& dev, const MAC::MacAddr& mac) const;
+
+  /**
+   * @brief Add an equal-cost next hop
+   *
+   * @return true added
+   * @return false already in, or too many hops
+   */
+  bool addHop(const Device::DevicePtr& dev, const MAC::MacAddr& mac) const;
+
+  /**
+   * @brief Remove a next hop
+   *
+   * @param mac MAC address of the hop
+   * @return int number of hops left
+   */
+  int delHop(const MAC::MacAddr& mac) const;
+
+  /**
+   * @brief Pick a next hop for a flow by rendezvous hashing: the hop with the
+   * highest score of (flow, hop) is chosen. Removing a hop moves only the
+   * flows on it, adding a hop moves only the flows it wins.
+   *
+   * @param flowHash flow hash of the packet
+   * @return const NextHop& the hop
+   */
+  const NextHop& pickHop(uint32_t flowHash) const;
+
+ private:
+  void syncPrimary() const;
 };
 
 /**
@@ -161,6 +230,37 @@ class SDPManager {
    */
   void sendSDPPackets(const SDPItemVector& sis, int flag = 0,
                       Device::DevicePtr withoutDev = nullptr);
+
+  /**
+   * @brief Collect the items of an advertisement split over frames. Items of
+   * frames with `SDPFLAG_UNFINISH` are kept until the last frame from the
+   * same neighbor comes, which gets all of them. An advertisement is dropped
+   * if its last frame does not come in `SDP_REASSEMBLY_TIMEOUT` seconds from
+   * the first one, or if it has more than `SDP_REASSEMBLY_MAX_ITEMS` items.
+   * Frames of new advertisements are dropped while
+   * `SDP_REASSEMBLY_MAX_PENDING` ones are being collected.
+   *
+   * @param id device receiving the frame
+   * @param mac MAC address of the neighbor
+   * @param flag flag of the frame
+   * @param sis items of the frame, all items of the advertisement if complete
+   * @return int 1 if the advertisement is complete, 0 if more frames come or
+   * it is dropped
+   */
+  int reassemble(DeviceId id, const MAC::MacAddr& mac, int flag,
+                 SDPItemVector& sis);
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Pending {
+    SDPItemVector sis;
+    Clock::time_point expire;
+    bool dropped = false;  // too large, frames are dropped until the last
+  };
+
+  std::unordered_map<uint64_t, Pending> pending;  // by device and neighbor
+  std::mutex pending_m;
 };
 
 extern SDPManager sdpMgr;
@@ -204,10 +304,12 @@ void printSDP(const SDP::SDPPacket& sdpp, bool sender = false);
  * |                              ...                              |
  * +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
  *
- * Length: the number of routing item (max is 255)
+ * Length: the number of routing item (max is 255, and the frame is no longer
+ * than the MTU of the device)
  * Flags: [rrrrvnui]
  *   i Increment  : is an increment routing information.
- *   u Unfinished : have more packet because of length limited
+ *   u Unfinished : have more packet because of length limited, items are
+ *                  applied together after the packet without this flag
  *   n isNew      : is a new device added into network
  *   v Varify     : is a varify frame
  * Item Flag: [rrrrrrrd]
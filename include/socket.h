@@ -4,7 +4,8 @@
  * @version 0.1
  * @date 2019-10-24
  *
- * @brief POSIX-compatible socket library supporting TCP protocol on IPv4.
+ * @brief POSIX-compatible socket library supporting TCP and UDP protocol on
+ * IPv4.
  *
  */
 
@@ -22,6 +23,7 @@
 #include "router.h"
 #include "socketaddr.h"
 #include "tcp.h"
+#include "udp.h"
 
 namespace Socket {
 /**
@@ -75,7 +77,8 @@ class Socket {
 using SocketPtr = std::shared_ptr<Socket>;
 
 /**
- * @brief A manager managing all sockets
+ * @brief A manager managing all sockets. UDP sockets are kept by
+ * `Udp::udpMgr` and share the file descriptions with TCP ones.
  *
  */
 class SocketManager {
@@ -94,6 +97,10 @@ class SocketManager {
   int connect(int socket, const sockaddr* address, socklen_t address_len);
   ssize_t read(int fildes, u_char* buf, size_t nbyte);
   ssize_t write(int fildes, const u_char* buf, size_t nbyte);
+  ssize_t sendto(int socket, const u_char* buf, size_t nbyte, int flags,
+                 const sockaddr* dest_addr, socklen_t dest_len);
+  ssize_t recvfrom(int socket, u_char* buf, size_t nbyte, int flags,
+                   sockaddr* address, socklen_t* address_len);
   int close(int fildes);
 };
 
@@ -70,6 +70,8 @@ class TcpWorker {
   std::condition_variable_any sendCv;          // wait for not empty
   std::condition_variable_any sendNonBlockCv;  // wait for not empty
   std::condition_variable_any recvCv;          // wait for not empty
+  Ip::DstCache dstCache;                       // used by sender
+  Ip::DstCache dstCacheNonBlock;               // used by senderNonBlock
 
   int backlog;  // ength of the listen queue. 0 for any
   std::queue<std::pair<Socket::SocketAddr, tcp_seq>>
@@ -87,7 +89,7 @@ class TcpWorker {
 
   ssize_t send(TcpItem& ti);
   ssize_t read(u_char* buf, size_t nbyte);
-  void handler(TcpItem& ts);
+  void handler(const TcpView& recvti);
   void senderLoop();
   void senderNonBlockLoop();
 };
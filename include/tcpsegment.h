@@ -16,6 +16,7 @@
 #include <shared_mutex>
 
 #include "ip.h"
+#include "pmtu.h"
 #include "socketaddr.h"
 #include "tcpseq.h"
 
@@ -105,6 +106,44 @@ struct TcpItem {
   void setChecksum();
 };
 
+/**
+ * @brief A non-owning view of a received tcp segment. Only the header is copied
+ * (and converted to host order), payload stays in the receive buffer.
+ *
+ */
+struct TcpView {
+  tcphdr hdr;          // header in host order
+  const u_char* seg;   // segment in network order
+  const u_char* data;  // payload
+  int totalLen;
+  int dataLen;
+  ip_addr srcIp;
+  ip_addr dstIp;
+
+  /**
+   * @brief Construct a new Tcp View object
+   *
+   * @param buf segment buffer
+   * @param len length of segment
+   * @param src src ip
+   * @param dst dst ip
+   */
+  TcpView(const void* buf, int len, ip_addr src, ip_addr dst);
+
+  /**
+   * @brief Whether the header and payload are inside the buffer
+   *
+   */
+  bool valid() const { return dataLen >= 0; }
+
+  /**
+   * @brief Check checksum with pseudo header
+   *
+   * @return true on right, false on error
+   */
+  bool chkChksum() const;
+};
+
 /**
  * @brief Build an ACK item automatically.
  *
@@ -124,6 +163,16 @@ TcpItem buildAckItem(Socket::SocketAddr src, Socket::SocketAddr dst,
                      std::optional<int>(ackLen) = 1,
                      std::optional<tcp_seq>(ackSeq) = {});
 
+/**
+ * @brief Get the max length of payload in a segment, so that the segment fits
+ * in the path MTU
+ *
+ * @param src src ip
+ * @param dst dst ip
+ * @return int MSS
+ */
+int getMss(const ip_addr& src, const ip_addr& dst);
+
 }  // namespace Tcp
 
 namespace Printer {
@@ -137,6 +186,13 @@ namespace Printer {
  */
 void printTcpItem(const Tcp::TcpItem& ts, bool sender = false,
                   std::string info = "");
+
+/**
+ * @brief Print a received tcp segment
+ *
+ * @param tv tcp view
+ */
+void printTcpView(const Tcp::TcpView& tv);
                   
 }  // namespace Printer
 
@@ -54,10 +54,30 @@ using ip_addr = in_addr;
  */
 using frameReceiveCallback = int (*)(const void*, int, DeviceId);
 
+/**
+ * @brief A frame received, in a batch
+ *
+ */
+struct RxFrame {
+  const u_char* buf;  // the frame
+  int len;            // length of the frame
+  DeviceId id;        // the device receiving the frame
+  int64_t ts;         // time captured, ns of the system clock, 0 if unknown
+};
+
+/**
+ * @brief Process a batch of frames upon receiving them.
+ *
+ * @param frames frames received, valid until the callback returns
+ * @param n number of frames
+ * @return 0 on success, -1 on error.
+ */
+using frameBatchReceiveCallback = int (*)(const RxFrame*, int);
+
 /**
  * @brief Process an IP packet upon receiving it.
  *
- * @param buf Pointer to the packet.
+ * @param buf Pointer to the packet, in network byte order.
  * @param len Length of the packet.
  * @return 0 on success, -1 on error.
  * @see addDevice
@@ -69,4 +89,15 @@ using commonReceiveCallback = int (*)(const void*, int, DeviceId);
 bool operator<(ip_addr a, ip_addr b);
 bool operator==(ip_addr a, ip_addr b);
 
+/**
+ * @brief Hash of an ip address
+ *
+ */
+struct IpHash {
+  size_t operator()(const ip_addr& a) const {
+    uint64_t h = a.s_addr * 0x9e3779b97f4a7c15ULL;
+    return static_cast<size_t>(h ^ (h >> 32));
+  }
+};
+
 #endif  // TYPE_H_
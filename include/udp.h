@@ -0,0 +1,153 @@
+/**
+ * @file udp.h
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-07
+ *
+ * @brief Library supporting UDP datagram sockets.
+ *
+ */
+
+#ifndef UDP_H_
+#define UDP_H_
+
+#include <netinet/udp.h>
+
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+
+#include "ip.h"
+#include "socketaddr.h"
+
+// max datagrams waiting in the receive queue of a socket
+#define UDP_RECV_QUEUE 256
+// bytes of data waiting in the receive queue of a socket
+#define UDP_RECV_BYTES (256 * 1024)
+// first port given to sockets sending without bind
+#define UDP_EPHEMERAL_PORT 49152
+
+namespace Udp {
+
+/**
+ * @brief A UDP socket. Datagrams received are stored one after another in a
+ * ring of bytes, and the queue holds their descriptors only.
+ *
+ */
+class UdpSocket {
+ public:
+  int fd;
+  Socket::SocketAddr src;  // bound address
+  Socket::SocketAddr dst;  // default destination set by connect
+
+  UdpSocket(int fd);
+
+  int bind(const Socket::SocketAddr& addr);
+  int connect(const Socket::SocketAddr& addr);
+
+  /**
+   * @brief Send a datagram. The header is built on the stack and the data is
+   * copied only once, into the frame.
+   *
+   * @param buf data
+   * @param nbyte length of data
+   * @param to destination
+   * @return ssize_t bytes sent, -1 on error
+   */
+  ssize_t sendto(const u_char* buf, size_t nbyte, const Socket::SocketAddr& to);
+
+  /**
+   * @brief Receive a datagram, the rest of a datagram longer than the buffer
+   * is discarded.
+   *
+   * @param buf buffer
+   * @param nbyte length of buffer
+   * @param from source will be stored in if not nullptr
+   * @param block wait for a datagram if the queue is empty
+   * @return ssize_t bytes received, -1 on error
+   */
+  ssize_t recvfrom(u_char* buf, size_t nbyte, Socket::SocketAddr* from,
+                   bool block = true);
+
+  /**
+   * @brief Queue a datagram received, dropped if the queue is full
+   *
+   * @param from source
+   * @param data data of the datagram
+   * @param len length of data
+   * @return int 0 on success, -1 if dropped
+   */
+  int push(const Socket::SocketAddr& from, const u_char* data, int len);
+
+  int close();
+
+ private:
+  // a datagram in the receive queue, off is the position in the ring
+  struct Desc {
+    Socket::SocketAddr src;
+    size_t off;
+    int len;
+  };
+
+  Desc descs[UDP_RECV_QUEUE];
+  size_t head = 0, tail = 0;  // of descs
+  std::unique_ptr<u_char[]> bytes;
+  size_t byteHead = 0, byteTail = 0;  // of bytes
+  bool closed = false;
+  std::mutex m;
+  std::condition_variable cv;
+};
+using UdpSocketPtr = std::shared_ptr<UdpSocket>;
+
+/**
+ * @brief A manager managing all UDP sockets, by fd and by port bound
+ *
+ */
+class UdpManager {
+ public:
+  /**
+   * @brief Create a socket
+   *
+   * @param fd file description given by `Socket::SocketManager`
+   * @return int fd
+   */
+  int socket(int fd);
+
+  UdpSocketPtr getSocket(int fd);
+  UdpSocketPtr getSocket(const Socket::SocketAddr& addr);
+
+  /**
+   * @brief Bind a socket to an address, a port is chosen if it is zero
+   *
+   * @param sock the socket
+   * @param addr address to bind
+   * @return int 0 on success, -1 on error
+   */
+  int bind(const UdpSocketPtr& sock, Socket::SocketAddr addr);
+
+  int close(int fd);
+
+ private:
+  std::unordered_map<int, UdpSocketPtr> sockets;
+  std::unordered_map<in_port_t, UdpSocketPtr> ports;
+  in_port_t nextPort = UDP_EPHEMERAL_PORT;
+  std::shared_mutex m;
+};
+
+extern UdpManager udpMgr;
+
+/**
+ * @brief Callback for UDP datagrams sent to me. Datagrams to a port without
+ * a socket are passed to `Ip::callback` if set.
+ *
+ * @param buf the IP packet, in network order
+ * @param len length
+ * @return int 0 on success, -1 on error
+ */
+int udpCallBack(const void* buf, int len);
+
+}  // namespace Udp
+
+#endif  // UDP_H_
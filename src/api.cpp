@@ -1,6 +1,5 @@
 #include "api.h"
 
-#include <unordered_map>
 #include <variant>
 
 bool initialed = false;
@@ -51,6 +50,20 @@ ssize_t write(int fildes, const void* buf, size_t nbyte) {
                                nbyte);
 }
 
+ssize_t sendto(int socket, const void* buf, size_t nbyte, int flags,
+               const struct sockaddr* dest_addr, socklen_t dest_len) {
+  checkInitial();
+  return Socket::sockmgr.sendto(socket, reinterpret_cast<const u_char*>(buf),
+                                nbyte, flags, dest_addr, dest_len);
+}
+
+ssize_t recvfrom(int socket, void* buf, size_t nbyte, int flags,
+                 struct sockaddr* address, socklen_t* address_len) {
+  checkInitial();
+  return Socket::sockmgr.recvfrom(socket, reinterpret_cast<u_char*>(buf),
+                                  nbyte, flags, address, address_len);
+}
+
 ssize_t close(int fildes) {
   checkInitial();
   return Socket::sockmgr.close(fildes);
@@ -62,9 +75,11 @@ int getaddrinfo(const char* node, const char* service,
   if (!node && !service) return EAI_NONAME;
   if (hints) {
     if (hints->ai_family != AF_INET) return EAI_FAMILY;
-    if ((hints->ai_socktype != SOCK_STREAM) ||
-        (hints->ai_protocol != IPPROTO_TCP))
-      return EAI_SOCKTYPE;
+    bool tcp = hints->ai_socktype == SOCK_STREAM &&
+               hints->ai_protocol == IPPROTO_TCP;
+    bool udp = hints->ai_socktype == SOCK_DGRAM &&
+               (hints->ai_protocol == 0 || hints->ai_protocol == IPPROTO_UDP);
+    if (!tcp && !udp) return EAI_SOCKTYPE;
     if (hints->ai_flags != 0) return EAI_BADFLAGS;
   }
 
@@ -76,8 +91,9 @@ int getaddrinfo(const char* node, const char* service,
 
   addrinfo* rp = new addrinfo;
   rp->ai_family = AF_INET;
-  rp->ai_socktype = SOCK_STREAM;
-  rp->ai_protocol = IPPROTO_TCP;
+  bool udp = hints && hints->ai_socktype == SOCK_DGRAM;
+  rp->ai_socktype = udp ? SOCK_DGRAM : SOCK_STREAM;
+  rp->ai_protocol = udp ? IPPROTO_UDP : IPPROTO_TCP;
   rp->ai_addrlen = INET_ADDRSTRLEN;
   rp->ai_addr = reinterpret_cast<sockaddr*>(addr);
   rp->ai_next = NULL;
@@ -96,50 +112,88 @@ void freeaddrinfo(struct addrinfo* res) {
 }
 }  // namespace socket
 
-std::unordered_map<u_short, commonReceiveCallback> callbackMap;
+namespace {
+constexpr int FIXED_ETHERTYPES = 3;
+constexpr int MAX_CUSTOM_ETHERTYPES = 8;
+
+// slot of well-known ether types in the dispatch table, -1 for others
+constexpr int etherTypeSlot(u_short type) {
+  switch (type) {
+    case ETHERTYPE_IP:
+      return 0;
+    case ETHERTYPE_ARP:
+      return 1;
+    case ETHERTYPE_SDP:
+      return 2;
+    default:
+      return -1;
+  }
+}
+static_assert(etherTypeSlot(ETHERTYPE_IP) == 0, "IPv4 should be slot 0");
+
+/**
+ * @brief Flat ether type dispatch table: fixed slots for IPv4, ARP and SDP,
+ * and a few slots for types registered by `setCallback`.
+ *
+ */
+struct EtherDispatchTable {
+  commonReceiveCallback fixed[FIXED_ETHERTYPES] = {};
+  u_short customType[MAX_CUSTOM_ETHERTYPES] = {};
+  commonReceiveCallback custom[MAX_CUSTOM_ETHERTYPES] = {};
+  int customCnt = 0;
+
+  commonReceiveCallback* find(u_short type) {
+    int slot = etherTypeSlot(type);
+    if (slot >= 0) return &fixed[slot];
+    for (int i = 0; i < customCnt; ++i)
+      if (customType[i] == type) return &custom[i];
+    return nullptr;
+  }
+};
+
+EtherDispatchTable callbackTable;
+}  // namespace
 
 int callbackDispatcher(const void* buf, int len, DeviceId id) {
-  auto frame = Ether::EtherFrame(buf, len);
-  if (frame.getLength() == 0) return 0;
-
-  frame.ntohType();
-  // Printer::printEtherFrame(frame);
-  auto hdr = frame.getHeader();
-  auto dev = Device::deviceMgr.getDevicePtr(id);
-
-  // MAC address: src is me?
-  if (MAC::isSameMacAddr(dev->getMAC(), hdr.ether_shost)) {
-    LOG_DBG("Ignore a packet, src is me! %s",
-            MAC::toString(hdr.ether_shost).c_str());
-    // ignore it;
+  Ether::EtherView frame(buf, len);
+  if (!frame.valid()) {
+    LOG(ERR, "bad packet length: %d", len);
     return 0;
   }
+  // frames not for me, such as those sent by me, never take tokens
+  id = Device::deviceMgr.acceptFrame(id, frame);
+  if (id < 0) return 0;
 
-  // MAC address: dst is me or broadcast?
-  if (MAC::isSameMacAddr(dev->getMAC(), hdr.ether_dhost) ||
-      MAC::isBroadcast(hdr.ether_dhost)) {
-    u_short type = hdr.ether_type;
-
-    auto iter = callbackMap.find(type);
+  // drop an ARP storm before resolving anything
+  if (frame.getType() == ETHERTYPE_ARP && !Policer::policer.admitArp(frame))
+    return 0;
 
-    if (iter == callbackMap.end()) {
-      // LOG_ERR("Callback function not found");
-      // return -1;
-      return 0;
-    } else {
-      if (iter->second)
-        return iter->second(frame.getPayload(), len - ETHER_HDR_LEN, id);
-      else
-        return -1;
-    }
+  auto cb = callbackTable.find(frame.getType());
+  if (!cb || !*cb) {
+    // LOG_ERR("Callback function not found");
+    // return -1;
+    return 0;
   }
-
-  // Ignore other frame
-  return 0;
+  return (*cb)(frame.getPayload(), frame.getPayloadLength(), id);
 }
 
 int setCallback(u_short etherType, commonReceiveCallback callback) {
-  return (callbackMap.insert_or_assign(etherType, callback)).second;
+  auto cb = callbackTable.find(etherType);
+  if (cb) {
+    int inserted = (*cb == nullptr);
+    *cb = callback;
+    return inserted;
+  }
+
+  if (callbackTable.customCnt == MAX_CUSTOM_ETHERTYPES) {
+    LOG_ERR("Too many ether types registered.");
+    return -1;
+  }
+  int i = callbackTable.customCnt;
+  callbackTable.customType[i] = etherType;
+  callbackTable.custom[i] = callback;
+  callbackTable.customCnt++;
+  return 1;
 }
 
 int init() {
@@ -147,7 +201,9 @@ int init() {
   setCallback(ETHERTYPE_ARP, Arp::arpCallBack);
   setCallback(ETHERTYPE_IP, Ip::ipCallBack);
   setCallback(ETHERTYPE_SDP, SDP::sdpCallBack);
-  setIPPacketReceiveCallback(Socket::tcpDispatcher);
+  setProtocolCallback(IPPROTO_TCP, Socket::tcpDispatcher);
+  setProtocolCallback(IPPROTO_UDP, Udp::udpCallBack);
+  setProtocolCallback(IPPROTO_ICMP, Icmp::icmpCallBack);
   addAllDevice(true);
   initRouter();
   return 0;
@@ -164,16 +220,47 @@ int setFrameReceiveCallback(frameReceiveCallback callback) {
   return 0;
 }
 
+int setBatchMode(bool enable) {
+  Device::batchCallback.store(enable ? Pipeline::processBatch : nullptr);
+  return 0;
+}
+
+int setForwardWorkers(int n) {
+  Forward::engine.stop();
+  if (n == 0) return 0;
+  return Forward::engine.start(n);
+}
+
+uint64_t getForwardDropped() { return Forward::engine.getDropped(); }
+
+int setPolicer(Policer::Class c, uint32_t rate, uint32_t burst,
+               uint32_t sourceRate, uint32_t sourceBurst) {
+  if (Policer::policer.setClassRate(c, rate, burst) < 0) return -1;
+  return Policer::policer.setSourceRate(c, sourceRate, sourceBurst);
+}
+
+Policer::Counters getPolicerCounters(Policer::Class c) {
+  return Policer::policer.getCounters(c);
+}
+
 int sendIPPacket(const struct in_addr src, const struct in_addr dest, int proto,
                  const void* buf, int len) {
   return Ip::sendIPPacket(src, dest, proto, buf, len);
 }
 
+int sendIPPackets(const Ip::Packet* packets, size_t n) {
+  return Ip::sendIPPackets(packets, n);
+}
+
 int setIPPacketReceiveCallback(IPPacketReceiveCallback callback) {
   Ip::callback = callback;
   return 0;
 }
 
+int setProtocolCallback(uint8_t proto, IPPacketReceiveCallback callback) {
+  return Ip::setProtocolCallback(proto, callback);
+}
+
 int setRoutingTable(const in_addr dest, const in_addr mask,
                     const void* nextHopMAC, const char* device) {
   auto nm = MAC::MacAddr((const u_char*)nextHopMAC);
@@ -184,5 +271,16 @@ int setRoutingTable(const in_addr dest, const in_addr mask,
 
 int addAllDevice(bool sniff) { return Device::deviceMgr.addAllDevice(sniff); }
 
+int addBondDevice(const char* name, const std::vector<std::string>& members) {
+  DeviceId id = Device::deviceMgr.addBondDevice(name, members);
+  if (id < 0) return -1;
+
+  // routes via members are now via the bond
+  auto bond = Device::deviceMgr.getDevicePtr(id);
+  for (auto& m : members)
+    Route::router.rebindDevice(Device::deviceMgr.getDevicePtr(m), bond);
+  return id;
+}
+
 void initRouter() { Route::router.init(); }
 }  // namespace api
\ No newline at end of file
@@ -31,6 +31,17 @@ ssize_t __wrap_write(int fildes, const void* buf, size_t nbyte) {
   return api::socket::write(fildes, buf, nbyte);
 }
 
+ssize_t __wrap_sendto(int socket, const void* buf, size_t nbyte, int flags,
+                      const struct sockaddr* dest_addr, socklen_t dest_len) {
+  return api::socket::sendto(socket, buf, nbyte, flags, dest_addr, dest_len);
+}
+
+ssize_t __wrap_recvfrom(int socket, void* buf, size_t nbyte, int flags,
+                        struct sockaddr* address, socklen_t* address_len) {
+  return api::socket::recvfrom(socket, buf, nbyte, flags, address,
+                               address_len);
+}
+
 ssize_t __wrap_close(int fildes) { return api::socket::close(fildes); }
 
 int __wrap_getaddrinfo(const char* node, const char* service,
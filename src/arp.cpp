@@ -1,5 +1,7 @@
 #include "arp.h"
 
+#include "router.h"
+
 namespace Arp {
 
 ArpManager arpMgr;
@@ -13,8 +15,9 @@ int arpCallBack(const void* buf, int len, DeviceId id) {
   switch (frame.arpHdr.ar_op) {
     // any reply: add to ARP table
     case ARPOP_REPLY: {
-      arpMgr.ipMacMap[frame.srcIp] = MAC::MacAddr(frame.srcMac);
+      arpMgr.setMacAddr(frame.srcIp, MAC::MacAddr(frame.srcMac));
       arpMgr.cv.notify_all();
+      arpMgr.flush(frame.srcIp, MAC::MacAddr(frame.srcMac));
       // LOG_INFO("ARP table update");
       // Printer::printArpTable();
       break;
@@ -57,17 +60,15 @@ void ArpFrame::ntohType() {
 MAC::MacAddr ArpManager::getMacAddr(Device::DevicePtr dev, const ip_addr& dstIp,
                                     int maxRetry) {
   // have it: tell you!
-  auto iter = ipMacMap.find(dstIp);
-  if (iter != ipMacMap.end()) return iter->second;
+  MAC::MacAddr mac;
+  if (lookup(dstIp, mac)) return mac;
 
   // well, ask it anyway
   // LOG_INFO("Send ARP request to %s", inet_ntoa(dstIp));
   int res = sendRequestArp(dev, dstIp, maxRetry);
-  if (res >= 0) {
-    iter = ipMacMap.find(dstIp);
-    // LOG_INFO("Get mac address: %s",
-    // MAC::toString(iter->second.addr).c_str());
-    return iter->second;
+  if (res >= 0 && lookup(dstIp, mac)) {
+    // LOG_INFO("Get mac address: %s", MAC::toString(mac.addr).c_str());
+    return mac;
   } else {
     LOG_WARN("MAC not found.");
     return MAC::MacAddr();
@@ -79,6 +80,27 @@ int ArpManager::sendRequestArp(Device::DevicePtr dev, const ip_addr& dstIp,
   std::unique_lock<std::mutex> lock(cv_m);
   // lock.lock();
 
+  // wait ...
+  int cnt = 0;
+  int found = -1;
+  for (int i = maxRetry + 1; i != 0; --i, ++cnt) {
+    sendRequest(dev, dstIp);
+    MAC::MacAddr mac;
+    if (cv.wait_for(lock, std::chrono::seconds(ARP_TIMEOUT),
+                    [&] { return lookup(dstIp, mac); })) {
+      found = 0;
+      break;
+    } else {
+      LOG_WARN("Request timeout for arp seq %d, dstip = %s", cnt,
+               inet_ntoa(dstIp));
+    }
+  }
+
+  lock.unlock();
+  return found;
+}
+
+void ArpManager::sendRequest(Device::DevicePtr dev, const ip_addr& dstIp) {
   // pack a ARP frame
   ArpFrame frame;
   frame.setDefaultHdr(ARPOP_REQUEST);
@@ -87,30 +109,115 @@ int ArpManager::sendRequestArp(Device::DevicePtr dev, const ip_addr& dstIp,
   memcpy(frame.srcMac, dev->getMAC(), ETHER_ADDR_LEN);
   memcpy(frame.dstMac, Ether::zeroMacAddr, ETHER_ADDR_LEN);
   frame.htonType();
+  Device::deviceMgr.sendFrame(&frame, sizeof(ArpFrame), ETHERTYPE_ARP,
+                              Ether::broadcastMacAddr, dev);
+}
 
-  // wait ...
-  int cnt = 0;
-  int found = -1;
-  for (int i = maxRetry + 1; i != 0; --i, ++cnt) {
-    Device::deviceMgr.sendFrame(&frame, sizeof(ArpFrame), ETHERTYPE_ARP,
-                                Ether::broadcastMacAddr, dev);
-    if (cv.wait_for(lock, std::chrono::seconds(ARP_TIMEOUT), [&] {
-          auto iter = ipMacMap.find(dstIp);
-          return iter != ipMacMap.end();
-        })) {
-      auto iter = ipMacMap.find(dstIp);
-      if (iter != ipMacMap.end()) {
-        found = 0;
-        break;
+int ArpManager::sendFrame(Device::DevicePtr dev, const ip_addr& dstIp,
+                          ether_header& hdr, const iovec* iov, int iovcnt) {
+  MAC::MacAddr mac;
+  if (!lookup(dstIp, mac)) {
+    std::unique_lock<std::mutex> lck(pending_m);
+    // the reply may arrive just now: look up again with the lock held, so
+    // that a frame queued is always seen by `flush`
+    if (!lookup(dstIp, mac)) {
+      auto iter = pending.find(dstIp);
+      bool request = iter == pending.end();
+      if (request) {
+        if (pending.size() >= ARP_PENDING_NEIGHBORS) {
+          LOG_WARN("Too many neighbors being resolved, drop frame to %s",
+                   inet_ntoa(dstIp));
+          return -1;
+        }
+        auto next = std::chrono::steady_clock::now() +
+                    std::chrono::seconds(ARP_TIMEOUT);
+        iter = pending.emplace(dstIp, Pending{dev, 0, next, {}}).first;
+        std::call_once(timerFlag, [this]() {
+          std::thread([this]() { timerLoop(); }).detach();
+        });
       }
-    } else {
-      LOG_WARN("Request timeout for arp seq %d, dstip = %s", cnt,
-               inet_ntoa(dstIp));
+      auto& frames = iter->second.frames;
+      if (frames.size() >= ARP_PENDING_FRAMES) frames.pop_front();
+      dev->getMAC(hdr.ether_shost);
+      frames.emplace_back(hdr, iov, iovcnt);
+      lck.unlock();
+
+      // the request is sent after the lock is released, as by `timerLoop`
+      if (request) sendRequest(dev, dstIp);
+      return 0;
     }
   }
+  memcpy(hdr.ether_dhost, mac.addr, ETHER_ADDR_LEN);
+  return Device::deviceMgr.sendFrame(dev, hdr, iov, iovcnt);
+}
 
-  lock.unlock();
-  return found;
+void ArpManager::flush(const ip_addr& ip, const MAC::MacAddr& mac) {
+  std::unique_lock<std::mutex> lck(pending_m);
+  auto iter = pending.find(ip);
+  if (iter == pending.end()) return;
+  Pending p = std::move(iter->second);
+  pending.erase(iter);
+  lck.unlock();
+
+  for (auto& f : p.frames) {
+    memcpy(f.frame.header.ether_dhost, mac.addr, ETHER_ADDR_LEN);
+    Device::deviceMgr.sendFrame(p.dev, f);
+  }
+}
+
+void ArpManager::timerLoop() {
+  while (true) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ARP_TICK));
+
+    // requests are sent after the lock is released
+    std::vector<std::pair<Device::DevicePtr, ip_addr>> requests;
+    auto now = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lck(pending_m);
+    for (auto iter = pending.begin(); iter != pending.end();) {
+      auto& p = iter->second;
+      if (p.next > now) {
+        ++iter;
+        continue;
+      }
+      if (p.retry >= ARP_MAX_RETRY) {
+        LOG_WARN("MAC of %s not found, drop %zu frames",
+                 inet_ntoa(iter->first), p.frames.size());
+        iter = pending.erase(iter);
+        continue;
+      }
+      ++p.retry;
+      p.next = now + std::chrono::seconds(ARP_TIMEOUT);
+      requests.emplace_back(p.dev, iter->first);
+      ++iter;
+    }
+    lck.unlock();
+
+    for (auto& r : requests) sendRequest(r.first, r.second);
+  }
+}
+
+bool ArpManager::lookup(const ip_addr& ip, MAC::MacAddr& mac) {
+  auto t = std::atomic_load(&table);
+  auto iter = t->find(ip);
+  if (iter == t->end()) return false;
+  mac = iter->second;
+  return true;
+}
+
+void ArpManager::setMacAddr(const ip_addr& ip, const MAC::MacAddr& mac) {
+  std::lock_guard<std::mutex> lck(table_m);
+  auto iter = table->find(ip);
+  if (iter != table->end() && iter->second == mac) return;
+
+  // copy on write
+  auto t = std::make_shared<ArpTable>(*table);
+  (*t)[ip] = mac;
+  std::atomic_store(&table, std::shared_ptr<const ArpTable>(std::move(t)));
+  ++Route::generation;
+}
+
+std::shared_ptr<const ArpTable> ArpManager::getTable() {
+  return std::atomic_load(&table);
 }
 
 void ArpManager::sendReplyArp(Device::DevicePtr dev, const u_char* dstMac,
@@ -133,7 +240,7 @@ namespace Printer {
 
 void printArpTable() {
   printf("\n\033[;1m============ ARP Table ============\033[0m\n");
-  for (auto& i : Arp::arpMgr.ipMacMap) {
+  for (auto& i : *Arp::arpMgr.getTable()) {
     printf("%s\t%s\n", inet_ntoa(i.first),
            MAC::toString(i.second.addr).c_str());
   }
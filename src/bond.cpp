@@ -0,0 +1,64 @@
+#include "bond.h"
+
+#include <algorithm>
+
+namespace Device {
+
+BondDevice::BondDevice(std::string name, const std::vector<DevicePtr>& members)
+    : Device(name, members.front()->getMAC(), members.front()->getIp(),
+             members.front()->getSubnetMask()),
+      members(members) {
+  for (auto& m : members) mtu = std::min(mtu, m->getMtu());
+}
+
+int BondDevice::sendFrame(Ether::EtherFrame& frame) {
+  auto m = pickMember(Flow::hash(frame));
+  return m ? m->sendFrame(frame) : -1;
+}
+
+int BondDevice::sendFrame(const ether_header& hdr, const iovec* iov,
+                          int iovcnt) {
+  auto m = pickMember(Flow::hash(hdr, iov, iovcnt));
+  return m ? m->sendFrame(hdr, iov, iovcnt) : -1;
+}
+
+int BondDevice::sendFrames(const FrameRef* frames, int n) {
+  std::vector<std::vector<FrameRef>> perMember(members.size());
+  for (int i = 0; i < n; ++i) {
+    auto m = pickMember(Flow::hash(*frames[i].hdr, frames[i].iov,
+                                   frames[i].iovcnt));
+    if (!m) return -1;
+    auto k = std::find(members.begin(), members.end(), m) - members.begin();
+    perMember[k].push_back(frames[i]);
+  }
+
+  int res = 0;
+  for (size_t k = 0; k < members.size(); ++k) {
+    auto& fs = perMember[k];
+    if (!fs.empty() && members[k]->sendFrames(fs.data(), fs.size()) < 0)
+      res = -1;
+  }
+  return res;
+}
+
+DevicePtr BondDevice::pickMember(uint32_t hash) {
+  // a member down takes a frame now and then, until one is sent
+  for (auto& m : members)
+    if (!m->isUp() && m->probeDue()) return m;
+
+  // by rendezvous hashing, only flows of a member leaving move
+  DevicePtr best;
+  uint64_t bestScore = 0;
+  for (size_t k = 0; k < members.size(); ++k) {
+    if (!members[k]->isUp()) continue;
+    uint64_t z = Flow::rendezvous(hash, k);
+    if (!best || z > bestScore) {
+      best = members[k];
+      bestScore = z;
+    }
+  }
+  if (!best) LOG_ERR("No member up in bond %s.", name.c_str());
+  return best;
+}
+
+}  // namespace Device
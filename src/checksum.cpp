@@ -0,0 +1,183 @@
+#include "checksum.h"
+
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CHECKSUM_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+/*
+ * All kernels add up the buffer as native 32-bit words into a 64-bit
+ * accumulator. One's complement sum does not depend on byte order (RFC 1071),
+ * so the folded result is already in network byte order in memory. A kernel
+ * only handles whole blocks and returns the number of bytes handled, the rest
+ * is added by `sumScalar`.
+ */
+
+uint64_t sumScalar(const uint8_t* data, size_t length) {
+  uint64_t acc = 0;
+
+  // Handle any complete 32-bit blocks.
+  const uint8_t* data_end = data + (length & ~3);
+  while (data != data_end) {
+    uint32_t word;
+    memcpy(&word, data, 4);
+    acc += word;
+    data += 4;
+  }
+  length &= 3;
+
+  // Handle any partial block at the end of the data.
+  if (length) {
+    uint32_t word = 0;
+    memcpy(&word, data, length);
+    acc += word;
+  }
+  return acc;
+}
+
+#ifdef CHECKSUM_X86
+
+__attribute__((target("sse2"))) size_t sumSse2(const uint8_t* data,
+                                               size_t length, uint64_t& res) {
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc = zero;
+  size_t i = 0;
+  for (; i + 16 <= length; i += 16) {
+    __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    acc = _mm_add_epi64(acc, _mm_unpacklo_epi32(v, zero));
+    acc = _mm_add_epi64(acc, _mm_unpackhi_epi32(v, zero));
+  }
+
+  uint64_t lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+  res = lanes[0] + lanes[1];
+  return i;
+}
+
+__attribute__((target("avx2"))) size_t sumAvx2(const uint8_t* data,
+                                               size_t length, uint64_t& res) {
+  const __m256i zero = _mm256_setzero_si256();
+  __m256i acc0 = zero, acc1 = zero;
+  size_t i = 0;
+  for (; i + 64 <= length; i += 64) {
+    __m256i v0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    __m256i v1 =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v0, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v0, zero));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v1, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v1, zero));
+  }
+  for (; i + 32 <= length; i += 32) {
+    __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+    acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+  }
+
+  uint64_t lanes[4];
+  _mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes),
+                      _mm256_add_epi64(acc0, acc1));
+  res = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+  return i;
+}
+
+__attribute__((target("avx512f"))) size_t sumAvx512(const uint8_t* data,
+                                                    size_t length,
+                                                    uint64_t& res) {
+  const __m512i zero = _mm512_setzero_si512();
+  __m512i acc0 = zero, acc1 = zero;
+  size_t i = 0;
+  for (; i + 64 <= length; i += 64) {
+    __m512i v = _mm512_loadu_si512(data + i);
+    acc0 = _mm512_add_epi64(acc0, _mm512_unpacklo_epi32(v, zero));
+    acc1 = _mm512_add_epi64(acc1, _mm512_unpackhi_epi32(v, zero));
+  }
+
+  res = _mm512_reduce_add_epi64(_mm512_add_epi64(acc0, acc1));
+  return i;
+}
+
+#endif
+
+uint64_t sum(Checksum::Kernel k, const uint8_t* data, size_t length) {
+  uint64_t acc = 0;
+  size_t done = 0;
+  switch (k) {
+#ifdef CHECKSUM_X86
+    case Checksum::Kernel::SSE2:
+      done = sumSse2(data, length, acc);
+      break;
+    case Checksum::Kernel::AVX2:
+      done = sumAvx2(data, length, acc);
+      break;
+    case Checksum::Kernel::AVX512:
+      done = sumAvx512(data, length, acc);
+      break;
+#endif
+    default:
+      break;
+  }
+  return acc + sumScalar(data + done, length - done);
+}
+
+uint16_t fold(uint64_t acc) {
+  // Handle deferred carries.
+  acc = (acc & 0xffffffff) + (acc >> 32);
+  while (acc >> 16) {
+    acc = (acc & 0xffff) + (acc >> 16);
+  }
+  return static_cast<uint16_t>(~acc);
+}
+
+Checksum::Kernel selectKernel() {
+#ifdef CHECKSUM_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return Checksum::Kernel::AVX512;
+  if (__builtin_cpu_supports("avx2")) return Checksum::Kernel::AVX2;
+  if (__builtin_cpu_supports("sse2")) return Checksum::Kernel::SSE2;
+#endif
+  return Checksum::Kernel::SCALAR;
+}
+
+}  // namespace
+
+namespace Checksum {
+
+std::string kernelToStr(Kernel k) {
+  switch (k) {
+#define X(KERNELNAME)      \
+  case Kernel::KERNELNAME: \
+    return #KERNELNAME;
+    CHECKSUM_KERNEL_SET
+#undef X
+    default:
+      return "";
+  }
+  return "";
+}
+
+bool isSupported(Kernel k) {
+  return static_cast<int>(k) <= static_cast<int>(getKernel());
+}
+
+Kernel getKernel() {
+  static const Kernel selected = selectKernel();
+  return selected;
+}
+
+uint16_t getChecksum(const void* vdata, size_t length) {
+  return getChecksum(getKernel(), vdata, length);
+}
+
+uint16_t getChecksum(Kernel k, const void* vdata, size_t length) {
+  // The initial 0xffff makes an all-zero buffer give 0 instead of 0xffff.
+  uint64_t acc = 0xffff;
+  acc += sum(k, reinterpret_cast<const uint8_t*>(vdata), length);
+  return fold(acc);
+}
+
+}  // namespace Checksum
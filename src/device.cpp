@@ -1,9 +1,12 @@
 #include "device.h"
 
+#include "bond.h"
+
 namespace Device {
 
 DeviceManager deviceMgr;
 frameReceiveCallback callback;
+std::atomic<frameBatchReceiveCallback> batchCallback{nullptr};
 
 int initDeviceMACAddr(u_char* mac, const char* if_name = DEFAULT_DEV_NAME) {
 #ifdef __APPLE__
@@ -60,6 +63,89 @@ std::pair<ip_addr, ip_addr> initDeviceIPAddr(const char* if_name) {
   return std::make_pair(ipAddr, mask);
 }
 
+// open a pcap handle only used to send frames
+pcap_t* openTxPcap(const char* if_name) {
+  char pcap_errbuf[PCAP_ERRBUF_SIZE];
+  memset(pcap_errbuf, 0, PCAP_ERRBUF_SIZE);
+  pcap_t* p = pcap_open_live(if_name, MAX_FRAME_SIZE, false, FRAME_TIME_OUT,
+                             pcap_errbuf);
+  if (!p) return nullptr;
+
+  // receive nothing on it
+  bpf_program prog;
+  if (pcap_compile(p, &prog, "less 1", 1, PCAP_NETMASK_UNKNOWN) == 0) {
+    pcap_setfilter(p, &prog);
+    pcap_freecode(&prog);
+  }
+  return p;
+}
+
+// a receiving pcap handle, stamping frames by the adapter if it can, with
+// the clock synced to the system clock, by the kernel otherwise
+pcap_t* openRxPcap(const char* if_name, char* errbuf, bool& hwTstamp) {
+  pcap_t* p = pcap_create(if_name, errbuf);
+  if (!p) return nullptr;
+  pcap_set_snaplen(p, MAX_FRAME_SIZE);
+  pcap_set_promisc(p, false);
+  pcap_set_timeout(p, FRAME_TIME_OUT);
+
+  hwTstamp = false;
+  int* types;
+  int n = pcap_list_tstamp_types(p, &types);
+  for (int i = 0; i < n; ++i)
+    if (types[i] == PCAP_TSTAMP_ADAPTER) hwTstamp = true;
+  if (n > 0) pcap_free_tstamp_types(types);
+  if (hwTstamp && pcap_set_tstamp_type(p, PCAP_TSTAMP_ADAPTER) != 0)
+    hwTstamp = false;
+  pcap_set_tstamp_precision(p, PCAP_TSTAMP_PRECISION_NANO);
+
+  // warnings are positive, such as a type of timestamp not supported
+  if (pcap_activate(p) < 0) {
+    snprintf(errbuf, PCAP_ERRBUF_SIZE, "%s", pcap_geterr(p));
+    pcap_close(p);
+    return nullptr;
+  }
+  return p;
+}
+
+// capture time of the frame handled by this thread
+thread_local int64_t rxTs = 0;
+
+int64_t captureTime(const struct pcap_pkthdr* header, int tsScale) {
+  return static_cast<int64_t>(header->ts.tv_sec) * 1000000000 +
+         static_cast<int64_t>(header->ts.tv_usec) * tsScale;
+}
+
+int64_t rxTimestamp() { return rxTs; }
+
+void setRxTimestamp(int64_t ts) { rxTs = ts; }
+
+// each sending thread sticks to one transmit queue
+std::atomic<int> nextTxSlot(0);
+int txSlot() {
+  thread_local int slot = nextTxSlot++;
+  return slot;
+}
+
+// whether a frame gathered from pieces fits in an ethernet frame
+bool frameFits(const iovec* iov, int iovcnt) {
+  size_t len = 0;
+  for (int i = 0; i < iovcnt; ++i) len += iov[i].iov_len;
+  if (len + ETHER_HDR_LEN > ETHER_MAX_LEN) {
+    LOG_ERR("len is too large: %zu.", len);
+    return false;
+  }
+  return true;
+}
+
+// time of the steady clock some seconds later, in ns
+int64_t probeTime(int seconds) {
+  auto t = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             t.time_since_epoch())
+      .count();
+}
+
 void getPacket(u_char* args, const struct pcap_pkthdr* header,
                const u_char* packet) {
   // args may be useless?(10.2)
@@ -73,11 +159,50 @@ void getPacket(u_char* args, const struct pcap_pkthdr* header,
   }
 
   if (callback != nullptr) {
+    rxTs = captureTime(header, pa->tsScale);
     int res = callback(packet, len, pa->id);
+    rxTs = 0;
+    if (res < 0) {
+      LOG_ERR("Callback error!");
+    }
+  }
+}
+
+void flushBatch(RxBatch& rx) {
+  if (rx.cnt && rx.cb) {
+    int res = rx.cb(rx.frames, rx.cnt);
     if (res < 0) {
       LOG_ERR("Callback error!");
     }
   }
+  rx.cnt = 0;
+}
+
+void getPacketBatch(u_char* args, const struct pcap_pkthdr* header,
+                    const u_char* packet) {
+  RxBatch* rx = reinterpret_cast<RxBatch*>(args);
+  int len = header->len;
+  if (len != static_cast<int>(header->caplen)) {
+    LOG_ERR("Data Lost.");
+    return;
+  }
+
+  // too large for a slot: handle it alone, after frames before it
+  if (len > RX_SLOT_SIZE) {
+    flushBatch(*rx);
+    rxTs = captureTime(header, rx->tsScale);
+    if (callback != nullptr && callback(packet, len, rx->id) < 0) {
+      LOG_ERR("Callback error!");
+    }
+    rxTs = 0;
+    return;
+  }
+
+  // the pcap buffer is reused after return, so copy it to a slot
+  memcpy(rx->slots[rx->cnt], packet, len);
+  rx->frames[rx->cnt] = {rx->slots[rx->cnt], len, rx->id,
+                         captureTime(header, rx->tsScale)};
+  if (++rx->cnt == RX_BATCH_SIZE) flushBatch(*rx);
 }
 
 //////////////////// Device ////////////////////
@@ -91,9 +216,12 @@ void Device::badDevice() {
 
 Device::~Device() {
   stopSniffing();
-  if (pcap) pcap_close(pcap);
   closed = true;
-  senderCv.notify_all();
+  for (auto& q : txQueues) {
+    q->cv.notify_all();
+    if (q->pcap != pcap) pcap_close(q->pcap);
+  }
+  if (pcap) pcap_close(pcap);
   if (pcapArgs) {
     delete pcapArgs;
   };
@@ -105,7 +233,7 @@ Device::Device(std::string name, bool sniff)
   id = (max_id++);
 
   // get MAC
-  if (initDeviceMACAddr(mac, name.c_str()) < 0) {
+  if (initDeviceMACAddr(mac.addr, name.c_str()) < 0) {
     // LOG_WARN("get MAC address failed. name: \033[1m%s\033[0m", name.c_str());
     badDevice();
     return;
@@ -124,56 +252,122 @@ Device::Device(std::string name, bool sniff)
   // obtain a PCAP descriptor
   char pcap_errbuf[PCAP_ERRBUF_SIZE];
   memset(pcap_errbuf, 0, PCAP_ERRBUF_SIZE);
-  // pcap = pcap_create(name.c_str(), pcap_errbuf);
-  pcap = pcap_open_live(name.c_str(), MAX_FRAME_SIZE, false, FRAME_TIME_OUT,
-                        pcap_errbuf);
-  if (pcap_errbuf[0] != '\0') {
-    LOG_WARN("pcap_open_live error! name: \033[1m%s\033[0m", name.c_str());
-    badDevice();
-    return;
-  }
+  pcap = openRxPcap(name.c_str(), pcap_errbuf, hwTstamp);
   if (!pcap) {
-    LOG_WARN("Cannot get pcap. name: \033[1m%s\033[0m", name.c_str());
+    LOG_WARN("Cannot get pcap: %s. name: \033[1m%s\033[0m", pcap_errbuf,
+             name.c_str());
     badDevice();
     return;
   }
+  tsScale =
+      pcap_get_tstamp_precision(pcap) == PCAP_TSTAMP_PRECISION_NANO ? 1 : 1000;
+  if (hwTstamp)
+    LOG_INFO("Adapter timestamps. name: \033[1m%s\033[0m", name.c_str());
 
   // start sniffing
   if (sniff) startSniffing();
   startSending();
 }
 
+Device::Device(std::string name, const u_char* m, ip_addr ip, ip_addr mask)
+    : id(max_id++),
+      name(name),
+      ip(ip),
+      subnetMask(mask),
+      pcap(nullptr),
+      sniffing(false),
+      pcapArgs(nullptr) {
+  memcpy(mac.addr, m, ETHER_ADDR_LEN);
+}
+
 DeviceId Device::getId() { return id; }
 
 std::string Device::getName() { return name; }
 
-void Device::getMAC(u_char* dst_mac) { memcpy(dst_mac, mac, ETHER_ADDR_LEN); }
+void Device::getMAC(u_char* dst_mac) {
+  memcpy(dst_mac, mac.addr, ETHER_ADDR_LEN);
+}
 
-const u_char* Device::getMAC() { return mac; }
+const u_char* Device::getMAC() { return mac.addr; }
 
 ip_addr Device::getIp() { return ip; }
 
 ip_addr Device::getSubnetMask() { return subnetMask; }
 
 int Device::sendFrame(Ether::EtherFrame& frame) {
-  std::unique_lock<std::mutex> lck(sender_m);
-  sender.push(frame);
+  if (txQueues.empty()) return -1;
+  auto& q = *txQueues[txSlot() % txQueues.size()];
+  std::unique_lock<std::mutex> lck(q.m);
+  q.frames.push(frame);
+  lck.unlock();
+  q.cv.notify_one();
+  return 0;
+}
+
+int Device::sendFrame(const ether_header& hdr, const iovec* iov,
+                      int iovcnt) {
+  if (txQueues.empty() || !frameFits(iov, iovcnt)) return -1;
+
+  auto& q = *txQueues[txSlot() % txQueues.size()];
+  std::unique_lock<std::mutex> lck(q.m);
+  q.frames.emplace(hdr, iov, iovcnt);
   lck.unlock();
-  senderCv.notify_all();
+  q.cv.notify_one();
   return 0;
 }
 
+int Device::sendFrames(const FrameRef* frames, int n) {
+  if (txQueues.empty()) return -1;
+  for (int i = 0; i < n; ++i)
+    if (!frameFits(frames[i].iov, frames[i].iovcnt)) return -1;
+
+  auto& q = *txQueues[txSlot() % txQueues.size()];
+  std::unique_lock<std::mutex> lck(q.m);
+  for (int i = 0; i < n; ++i)
+    q.frames.emplace(*frames[i].hdr, frames[i].iov, frames[i].iovcnt);
+  lck.unlock();
+  q.cv.notify_one();
+  return 0;
+}
+
+bool Device::probeDue() {
+  int64_t t = nextProbe.load();
+  if (probeTime(0) < t) return false;
+  // only the caller moving the time on sends the probe
+  return nextProbe.compare_exchange_strong(t, probeTime(DEV_PROBE_INTERVAL));
+}
+
 int Device::startSniffing() {
   if (sniffing) return -1;
 
   sniffing = true;
-  pcapArgs = new PcapArgs(id, name, mac);
+  pcapArgs = new PcapArgs(id, name, mac.addr);
+  pcapArgs->tsScale = tsScale;
   if (!pcap) {
     LOG_ERR("No pcap.");
     return -1;
   }
   sniffingThread = std::thread([=]() {
-    pcap_loop(pcap, -1, getPacket, reinterpret_cast<u_char*>(pcapArgs));
+    auto rx = std::make_unique<RxBatch>();
+    rx->id = id;
+    rx->tsScale = tsScale;
+    while (true) {
+      int res;
+      rx->cb = batchCallback.load();
+      if (rx->cb) {
+        // up to a batch of frames, then push them through the pipeline
+        res = pcap_dispatch(pcap, RX_BATCH_SIZE, getPacketBatch,
+                            reinterpret_cast<u_char*>(rx.get()));
+        flushBatch(*rx);
+      } else {
+        res = pcap_dispatch(pcap, -1, getPacket,
+                            reinterpret_cast<u_char*>(pcapArgs));
+      }
+      if (res < 0) {
+        LOG_ERR("Sniffing stopped: %s", pcap_geterr(pcap));
+        break;
+      }
+    }
   });
   return 0;
 }
@@ -189,30 +383,58 @@ int Device::stopSniffing() {
 }
 
 int Device::startSending() {
-  sendingThread = std::thread([&]() { senderLoop(); });
-  sendingThread.detach();
+  int n = std::min<int>(DEV_TX_QUEUES,
+                        std::max(1u, std::thread::hardware_concurrency()));
+  for (int i = 0; i < n; ++i) {
+    auto q = std::make_unique<TxQueue>();
+    q->pcap = (i == 0 ? pcap : openTxPcap(name.c_str()));
+    if (!q->pcap) break;
+    txQueues.push_back(std::move(q));
+  }
+
+  for (auto& q : txQueues) {
+    TxQueue* qp = q.get();
+    q->thread = std::thread([=]() { senderLoop(*qp); });
+    q->thread.detach();
+  }
   return 0;
 }
 
-void Device::senderLoop() {
-  std::unique_lock<std::mutex> lk(sender_m, std::defer_lock);
+void Device::senderLoop(TxQueue& q) {
+  std::unique_lock<std::mutex> lk(q.m, std::defer_lock);
+  std::queue<Ether::EtherFrame> batch;
+  int failures = 0;
 
   while (true) {
     lk.lock();
-    senderCv.wait(lk, [&]() { return (closed || (sender.size()) > 0); });
+    q.cv.wait(lk, [&]() { return (closed || q.frames.size() > 0); });
     if (closed) return;
-    while (sender.size()) {
-      auto frame = sender.front();
-      sender.pop();
+    // take all frames and send them without holding the lock
+    batch.swap(q.frames);
+    lk.unlock();
+
+    while (batch.size()) {
+      auto& frame = batch.front();
       frame.htonType();
 
       // send the ethernet frame
-      if (pcap_inject(pcap, frame.getFrame(), frame.getLength()) == -1) {
-        pcap_perror(pcap, 0);
+      if (pcap_inject(q.pcap, frame.getFrame(), frame.getLength()) == -1) {
+        pcap_perror(q.pcap, 0);
         LOG_ERR("Send frame failed.");
+        if (++failures == DEV_MAX_TX_FAILURES) {
+          LOG_WARN("Link down. name: \033[1m%s\033[0m", name.c_str());
+          nextProbe.store(probeTime(DEV_PROBE_INTERVAL));
+          up.store(false);
+        }
+      } else {
+        failures = 0;
+        if (!up.load()) {
+          LOG_INFO("Link up. name: \033[1m%s\033[0m", name.c_str());
+          up.store(true);
+        }
       }
+      batch.pop();
     }
-    lk.unlock();
   }
 }
 
@@ -278,7 +500,7 @@ DevicePtr DeviceManager::getDevicePtr(std::string name) {
 DevicePtr DeviceManager::getDevicePtr(const ip_addr& _ip) {
   DevicePtr devPtr = nullptr;
   for (auto& dev : devices) {
-    if (dev->getIp() == _ip) {
+    if (dev->getIp() == _ip && !dev->isSlave()) {
       devPtr = dev;
       break;
     }
@@ -286,6 +508,37 @@ DevicePtr DeviceManager::getDevicePtr(const ip_addr& _ip) {
   return devPtr;
 }
 
+DeviceId DeviceManager::addBondDevice(
+    std::string name, const std::vector<std::string>& memberNames) {
+  if (findDevice(name) >= 0) {
+    LOG_WARN("Device exists, no actions.");
+    return -1;
+  }
+
+  std::vector<DevicePtr> members;
+  for (auto& n : memberNames) {
+    auto dev = getDevicePtr(n);
+    if (!dev || dev->isSlave()) {
+      LOG_ERR("Device cannot be bonded. name: \033[1m%s\033[0m", n.c_str());
+      return -1;
+    }
+    members.push_back(dev);
+  }
+  if (members.empty()) {
+    LOG_ERR("No member for bond.");
+    return -1;
+  }
+
+  DevicePtr bond = std::make_shared<BondDevice>(name, members);
+  DeviceId id = bond->getId();
+  for (auto& m : members) m->setMasterId(id);
+  devices.push_back(bond);
+
+  LOG_INFO("id: %d, bond with %zu members, name: \033[33;1m%s\033[0m", id,
+           members.size(), name.c_str());
+  return id;
+}
+
 bool DeviceManager::haveDeviceWithIp(const ip_addr& ip) {
   for (auto& dev : devices) {
     if (dev->getIp() == ip) {
@@ -295,6 +548,36 @@ bool DeviceManager::haveDeviceWithIp(const ip_addr& ip) {
   return false;
 }
 
+DeviceId DeviceManager::acceptFrame(DeviceId id,
+                                    const Ether::EtherView& frame) {
+  auto dev = getDevicePtr(id);
+  if (!dev) return -1;
+  MAC::MacAddr srcMac(frame.srcMac()), dstMac(frame.dstMac());
+
+  // member of a bond: handle it as received by the bond
+  DevicePtr master = nullptr;
+  if (dev->isSlave()) {
+    master = getDevicePtr(dev->getMasterId());
+    id = master->getId();
+  }
+
+  // MAC address: src is me?
+  if (srcMac == dev->getMacAddr() ||
+      (master && srcMac == master->getMacAddr())) {
+    LOG_DBG("Ignore a packet, src is me! %s",
+            MAC::toString(srcMac.addr).c_str());
+    return -1;
+  }
+
+  // MAC address: dst is me or broadcast?
+  if (dstMac == dev->getMacAddr() ||
+      (master && dstMac == master->getMacAddr()) || dstMac.isBroadcast())
+    return id;
+
+  // Ignore other frame
+  return -1;
+}
+
 int DeviceManager::addAllDevice(bool sniff) {
   int cnt = 0;
 
@@ -346,6 +629,17 @@ int DeviceManager::sendFrame(DeviceId id, Ether::EtherFrame& frame) {
   return found;
 }
 
+int DeviceManager::sendFrame(DevicePtr dev, ether_header& hdr,
+                             const iovec* iov, int iovcnt) {
+  dev->getMAC(hdr.ether_shost);
+  int res = dev->sendFrame(hdr, iov, iovcnt);
+  if (res < 0) {
+    LOG_ERR("Sending frame failed. error code: %d", res);
+    return -1;
+  }
+  return 0;
+}
+
 int DeviceManager::sendFrame(const void* buf, int len, int ethtype,
                              const void* destmac, DevicePtr dev) {
   if ((len + ETHER_HDR_LEN) > ETHER_MAX_LEN) {
@@ -357,10 +651,8 @@ int DeviceManager::sendFrame(const void* buf, int len, int ethtype,
   hdr.ether_type = (u_short)ethtype;
   memcpy(hdr.ether_dhost, destmac, ETHER_ADDR_LEN);
 
-  Ether::EtherFrame frame;
-  frame.setHeader(hdr);
-  frame.setPayload((u_char*)buf, len);
-  return sendFrame(dev, frame);
+  iovec iov = {const_cast<void*>(buf), static_cast<size_t>(len)};
+  return sendFrame(dev, hdr, &iov, 1);
 }
 
 int DeviceManager::sendFrame(const void* buf, int len, int ethtype,
@@ -5,15 +5,6 @@
 
 namespace MAC {
 
-bool operator==(const MacAddr& ml, const MacAddr& mr) {
-  return isSameMacAddr(ml.addr, mr.addr);
-}
-
-const MacAddr& MacAddr::operator=(const MacAddr& m) {
-  memcpy(addr, m.addr, ETHER_ADDR_LEN);
-  return *this;
-}
-
 std::string toString(const u_char* mac) {
   char cstr[18] = "";
   sprintf(cstr, "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3],
@@ -29,20 +20,6 @@ void strtoMAC(u_char* mac, const char* str) {
   for (int i = 0; i < 6; ++i) mac[i] = static_cast<u_char>(tmp[i]);
 }
 
-bool isSameMacAddr(const u_char* macA, const u_char* macB) {
-  for (int i = 0; i < 6; ++i)
-    if (macA[i] != macB[i]) return false;
-  return true;
-}
-
-bool isBroadcast(const u_char* mac) {
-  return isSameMacAddr(mac, Ether::broadcastMacAddr);
-}
-
-bool isBroadcast(const MacAddr& mac) {
-  return isSameMacAddr(mac.addr, Ether::broadcastMacAddr);
-}
-
 }  // namespace MAC
 
 std::string etherToStr(uint16_t type) {
@@ -92,6 +69,21 @@ EtherFrame::EtherFrame(const void* buf, int l) : len(l) {
   memcpy(&frame, buf, len);
 }
 
+EtherFrame::EtherFrame(const ether_header& hdr, const iovec* iov, int iovcnt)
+    : len(ETHER_HDR_LEN) {
+  frame.header = hdr;
+  for (int i = 0; i < iovcnt; ++i) {
+    int l = iov[i].iov_len;
+    if (len - ETHER_HDR_LEN + l > ETHER_MAX_LEN) {
+      LOG(ERR, "packet length is too large. length : %d", len + l);
+      len = 0;
+      return;
+    }
+    memcpy(frame.payload + len - ETHER_HDR_LEN, iov[i].iov_base, l);
+    len += l;
+  }
+}
+
 }  // namespace Ether
 
 namespace Printer {
@@ -0,0 +1,119 @@
+#include "fib.h"
+
+#include <cstdlib>
+#include <new>
+
+namespace {
+uint32_t depthMask(int depth) { return depth ? ~0u << (32 - depth) : 0; }
+}  // namespace
+
+namespace Fib {
+
+Fib::Fib() {
+  // pages of the tables are not touched until prefixes are written there
+  tbl24 = static_cast<uint32_t*>(calloc(1 << 24, sizeof(uint32_t)));
+  tbl8 = static_cast<uint32_t*>(
+      calloc(static_cast<size_t>(FIB_TBL8_GROUPS) << 8, sizeof(uint32_t)));
+  if (!tbl24 || !tbl8) throw std::bad_alloc();
+  freeGroups.reserve(FIB_TBL8_GROUPS);
+  for (uint32_t g = FIB_TBL8_GROUPS; g > 0; --g) freeGroups.push_back(g - 1);
+}
+
+Fib::~Fib() {
+  free(tbl24);
+  free(tbl8);
+}
+
+int Fib::expand(uint32_t i) {
+  if (freeGroups.empty()) return -1;
+  uint32_t g = freeGroups.back();
+  freeGroups.pop_back();
+  // addresses of the group keep their route until a longer prefix is written
+  uint32_t* group = tbl8 + (g << 8);
+  for (int j = 0; j < 256; ++j) group[j] = tbl24[i];
+  store(tbl24[i], EXT | g);
+  return 0;
+}
+
+void Fib::collapse(uint32_t i) {
+  uint32_t g = tbl24[i] & ~EXT;
+  uint32_t* group = tbl8 + (g << 8);
+  uint32_t e = group[0];
+  if (e && entryDepth(e) > 24) return;
+  for (int j = 1; j < 256; ++j)
+    if (group[j] != e) return;
+  store(tbl24[i], e);
+  retiredGroups.push_back(g);
+}
+
+void Fib::reclaim() {
+  freeGroups.insert(freeGroups.end(), retiredGroups.begin(),
+                    retiredGroups.end());
+  retiredGroups.clear();
+}
+
+template <typename Match>
+int Fib::write(uint32_t prefix, int depth, uint32_t e, Match match) {
+  if (depth <= 24) {
+    uint32_t first = prefix >> 8, last = first + (1u << (24 - depth));
+    for (uint32_t i = first; i < last; ++i) {
+      uint32_t& t = tbl24[i];
+      if (!(t & EXT)) {
+        if (match(t)) store(t, e);
+        continue;
+      }
+      uint32_t* group = tbl8 + ((t & ~EXT) << 8);
+      for (int j = 0; j < 256; ++j)
+        if (match(group[j])) store(group[j], e);
+      collapse(i);
+    }
+    return 0;
+  }
+
+  uint32_t i = prefix >> 8;
+  if (!(tbl24[i] & EXT) && expand(i) < 0) return -1;
+  uint32_t* group = tbl8 + ((tbl24[i] & ~EXT) << 8);
+  uint32_t first = prefix & 0xff, last = first + (1u << (32 - depth));
+  for (uint32_t j = first; j < last; ++j)
+    if (match(group[j])) store(group[j], e);
+  collapse(i);
+  return 0;
+}
+
+int Fib::add(uint32_t prefix, int depth, uint32_t nh) {
+  if (depth < 0 || depth > 32 || nh > FIB_MAX_NEXTHOP) return -1;
+  prefix &= depthMask(depth);
+
+  // longer prefixes keep their entries
+  uint32_t e = makeEntry(nh, depth);
+  if (write(prefix, depth, e, [depth](uint32_t old) {
+        return !old || entryDepth(old) <= depth;
+      }) < 0)
+    return -1;
+  if (rules[depth].insert_or_assign(prefix, nh).second) ++count;
+  return 0;
+}
+
+int Fib::del(uint32_t prefix, int depth) {
+  if (depth < 0 || depth > 32) return -1;
+  prefix &= depthMask(depth);
+  if (rules[depth].erase(prefix) == 0) return -1;
+  --count;
+
+  // the longest prefix covering it takes its entries
+  uint32_t e = 0;
+  for (int d = depth - 1; d >= 0; --d) {
+    auto iter = rules[d].find(prefix & depthMask(d));
+    if (iter != rules[d].end()) {
+      e = makeEntry(iter->second, d);
+      break;
+    }
+  }
+  // a group is never needed to delete: the prefix has one already
+  write(prefix, depth, e, [depth](uint32_t old) {
+    return old && entryDepth(old) == depth;
+  });
+  return 0;
+}
+
+}  // namespace Fib
@@ -0,0 +1,117 @@
+#include "flow.h"
+
+namespace {
+inline uint32_t rotl(uint32_t x, int r) { return (x << r) | (x >> (32 - r)); }
+
+// one round of murmur3
+inline uint32_t mix(uint32_t h, uint32_t k) {
+  k *= 0xcc9e2d51;
+  k = rotl(k, 15);
+  k *= 0x1b873593;
+  h ^= k;
+  h = rotl(h, 13);
+  return h * 5 + 0xe6546b64;
+}
+
+inline uint32_t finalize(uint32_t h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+// hash MAC addresses only
+uint32_t hashMac(const ether_header& hdr) {
+  uint32_t h = 0x9747b28c, k = 0;
+  memcpy(&k, hdr.ether_dhost, 4);
+  h = mix(h, k);
+  k = 0;
+  memcpy(&k, hdr.ether_dhost + 4, 2);
+  memcpy(reinterpret_cast<u_char*>(&k) + 2, hdr.ether_shost + 4, 2);
+  h = mix(h, k);
+  return finalize(h);
+}
+}  // namespace
+
+namespace Flow {
+
+bool getFlowKey(const void* buf, int len, FlowKey& key) {
+  auto data = reinterpret_cast<const u_char*>(buf);
+  if (len < static_cast<int>(sizeof(ip))) return false;
+
+  ip hdr;
+  memcpy(&hdr, data, sizeof(ip));
+  int hl = hdr.ip_hl * 4;
+  if (hdr.ip_v != 4 || hl < static_cast<int>(sizeof(ip)) || hl > len)
+    return false;
+
+  key.src = hdr.ip_src.s_addr;
+  key.dst = hdr.ip_dst.s_addr;
+  key.proto = hdr.ip_p;
+  key.sport = key.dport = 0;
+
+  // only the first fragment carries ports, so ignore them for all fragments
+  bool fragment = (ntohs(hdr.ip_off) & (IP_MF | IP_OFFMASK)) != 0;
+  bool withPorts = (hdr.ip_p == IPPROTO_TCP || hdr.ip_p == IPPROTO_UDP);
+  if (withPorts && !fragment && len >= hl + 4) {
+    memcpy(&key.sport, data + hl, 2);
+    memcpy(&key.dport, data + hl + 2, 2);
+  }
+  return true;
+}
+
+uint32_t hash(const FlowKey& key) {
+  uint32_t h = 0x9747b28c;
+  h = mix(h, key.src);
+  h = mix(h, key.dst);
+  h = mix(h, (static_cast<uint32_t>(key.sport) << 16) | key.dport);
+  h = mix(h, key.proto);
+  return finalize(h);
+}
+
+uint32_t symmetricHash(const FlowKey& key) {
+  // order the two ends, so that swapping them gives the same key
+  FlowKey k = key;
+  if (k.src > k.dst || (k.src == k.dst && k.sport > k.dport)) {
+    std::swap(k.src, k.dst);
+    std::swap(k.sport, k.dport);
+  }
+  return hash(k);
+}
+
+uint32_t hash(const Ether::EtherFrame& frame) {
+  auto& hdr = frame.frame.header;
+  FlowKey key;
+  if (hdr.ether_type == ETHERTYPE_IP &&
+      getFlowKey(frame.frame.payload, frame.len - ETHER_HDR_LEN, key))
+    return hash(key);
+  return hashMac(hdr);
+}
+
+uint32_t hash(const ether_header& hdr, const iovec* iov, int iovcnt) {
+  if (hdr.ether_type == ETHERTYPE_IP) {
+    // the IP header with options and the ports
+    u_char head[64];
+    int n = 0;
+    for (int i = 0; i < iovcnt && n < 64; ++i) {
+      int take = std::min(64 - n, static_cast<int>(iov[i].iov_len));
+      memcpy(head + n, iov[i].iov_base, take);
+      n += take;
+    }
+    FlowKey key;
+    if (getFlowKey(head, n, key)) return hash(key);
+  }
+  return hashMac(hdr);
+}
+
+uint64_t rendezvous(uint32_t flowHash, uint64_t key) {
+  // splitmix64 finalizer of (flow, choice)
+  uint64_t z = (key << 16) ^ flowHash ^ 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+}  // namespace Flow
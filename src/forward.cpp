@@ -0,0 +1,105 @@
+#include "forward.h"
+
+namespace Forward {
+
+ForwardEngine engine;
+
+ForwardEngine::~ForwardEngine() {
+  stop();
+  for (auto& w : workers)
+    for (auto& r : w.rings) delete r.load();
+}
+
+int ForwardEngine::start(int n) {
+  if (run) {
+    LOG_ERR("Forwarding workers are running.");
+    return -1;
+  }
+  if (n <= 0 || n > FWD_MAX_WORKERS) {
+    LOG_ERR("Bad number of forwarding workers: %d", n);
+    return -1;
+  }
+  workerCnt = n;
+  run = true;
+  for (int i = 0; i < n; ++i)
+    workers[i].thread = std::thread([this, i]() { workerLoop(workers[i]); });
+  LOG_INFO("Start %d forwarding workers", n);
+  return 0;
+}
+
+void ForwardEngine::stop() {
+  if (!run) return;
+  run = false;
+  for (int i = 0; i < workerCnt; ++i) {
+    workers[i].cv.notify_one();
+    if (workers[i].thread.joinable()) workers[i].thread.join();
+  }
+}
+
+int ForwardEngine::getProducer() {
+  // producers keep their index for the whole process
+  thread_local int index = -1;
+  if (index < 0) {
+    index = producerCnt++;
+    if (index >= FWD_MAX_PRODUCERS)
+      LOG_WARN("Too many producers, forward packets in place.");
+  }
+  return index;
+}
+
+int ForwardEngine::submit(const Ip::IpView& ipv) {
+  int p = getProducer();
+  int len = ipv.getTotalLength();
+  if (p >= FWD_MAX_PRODUCERS || len > RX_SLOT_SIZE)
+    return Ip::forwardPacket(ipv);
+
+  Flow::FlowKey key;
+  Flow::getFlowKey(ipv.getPacket(), len, key);
+  Worker& w = workers[Flow::symmetricHash(key) % workerCnt];
+
+  Ring* ring = w.rings[p].load(std::memory_order_acquire);
+  if (!ring) {
+    ring = new Ring;
+    w.rings[p].store(ring, std::memory_order_release);
+  }
+  Slot* slot = ring->back();
+  // dropped on purpose, counted but not an error of the receiving thread
+  if (!slot) {
+    ++dropped;
+    return 0;
+  }
+  slot->len = len;
+  memcpy(slot->data, ipv.getPacket(), len);
+  ring->push();
+
+  if (w.sleeping) w.cv.notify_one();
+  return 0;
+}
+
+void ForwardEngine::workerLoop(Worker& w) {
+  while (true) {
+    int n = 0;
+    for (auto& r : w.rings) {
+      Ring* ring = r.load(std::memory_order_acquire);
+      if (!ring) continue;
+      for (int i = 0; i < FWD_BURST; ++i) {
+        Slot* slot = ring->front();
+        if (!slot) break;
+        Ip::forwardPacket(Ip::IpView(slot->data, slot->len));
+        ring->pop();
+        ++n;
+      }
+    }
+    if (n > 0) continue;
+    if (!run) break;
+
+    // a wakeup may be missed between the check and the wait, so wait for a
+    // short time only
+    std::unique_lock<std::mutex> lck(w.m);
+    w.sleeping = true;
+    w.cv.wait_for(lck, std::chrono::milliseconds(FWD_IDLE_WAIT));
+    w.sleeping = false;
+  }
+}
+
+}  // namespace Forward
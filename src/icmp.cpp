@@ -0,0 +1,239 @@
+#include "icmp.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+// the clock of capture timestamps, which adapters sync to
+using Clock = std::chrono::system_clock;
+
+// the probe running, echo replies are matched by id and sequence
+struct Prober {
+  std::mutex probe_m;  // one probe at a time
+  std::mutex m;        // mutex for fields below
+  std::condition_variable cv;
+  bool active = false;
+  uint16_t id = 0;
+  ip_addr dst;
+  std::vector<bool> seen;
+  std::vector<double> rtts;  // millisecond
+} prober;
+
+int64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Clock::now().time_since_epoch())
+      .count();
+}
+
+// nearest-rank percentile of sorted values
+double percentile(const std::vector<double>& v, double p) {
+  int k = std::ceil(p * v.size()) - 1;
+  return v[std::max(k, 0)];
+}
+
+// no error message is sent about an ICMP error message (RFC 1122)
+bool isIcmpError(const Ip::IpView& ipv) {
+  if (ipv.getProto() != IPPROTO_ICMP) return false;
+  if (ipv.getPayloadLength() < 1) return true;
+  return !ICMP_INFOTYPE(ipv.getPayload()[0]);
+}
+
+int fragNeededCallBack(const u_char* msg, int len) {
+  // the header and 8 bytes of the original packet follow the ICMP header
+  if (len < ICMP_MINLEN + static_cast<int>(sizeof(ip))) {
+    LOG_WARN("Bad ICMP Fragmentation Needed message.");
+    return 0;
+  }
+  uint16_t mtu;
+  memcpy(&mtu, msg + 6, sizeof(uint16_t));
+  ip orig;
+  memcpy(&orig, msg + ICMP_MINLEN, sizeof(ip));
+
+  // only care about packets sent by me
+  if (!Device::deviceMgr.haveDeviceWithIp(orig.ip_src)) return 0;
+  Pmtu::pmtuCache.update(orig.ip_dst, ntohs(mtu), ntohs(orig.ip_len));
+  return 0;
+}
+
+// reply with the request itself: change the type and patch the checksum, the
+// data is sent from the packet received
+int echoCallBack(const Ip::IpView& ipv, const u_char* msg, int len) {
+  u_char hdr[4] = {ICMP_ECHOREPLY, msg[1]};
+  uint16_t oldWord, newWord, sum;
+  memcpy(&oldWord, msg, sizeof(uint16_t));
+  memcpy(&newWord, hdr, sizeof(uint16_t));
+  memcpy(&sum, msg + 2, sizeof(uint16_t));
+  sum = Ip::updateChecksum(sum, oldWord, newWord);
+  memcpy(hdr + 2, &sum, sizeof(uint16_t));
+
+  iovec parts[2] = {
+      {hdr, 4}, {const_cast<u_char*>(msg + 4), static_cast<size_t>(len - 4)}};
+  return Ip::sendIPPacket(ipv.getDst(), ipv.getSrc(), IPPROTO_ICMP, parts, 2);
+}
+
+int echoReplyCallBack(const Ip::IpView& ipv, const u_char* msg, int len,
+                      int64_t recvNs) {
+  // the time of sending is the first 8 bytes of data
+  if (len < ICMP_MINLEN + 8) return 0;
+  uint16_t id, seq;
+  int64_t sentNs;
+  memcpy(&id, msg + 4, sizeof(uint16_t));
+  memcpy(&seq, msg + 6, sizeof(uint16_t));
+  memcpy(&sentNs, msg + ICMP_MINLEN, sizeof(int64_t));
+  id = ntohs(id);
+  seq = ntohs(seq);
+
+  std::lock_guard<std::mutex> lck(prober.m);
+  if (!prober.active || id != prober.id || !(ipv.getSrc() == prober.dst))
+    return 0;
+  if (seq >= prober.seen.size() || prober.seen[seq]) return 0;
+  prober.seen[seq] = true;
+  prober.rtts.push_back((recvNs - sentNs) / 1e6);
+  prober.cv.notify_all();
+  return 0;
+}
+}  // namespace
+
+namespace Icmp {
+
+int icmpCallBack(const void* buf, int len) {
+  // the capture time, or now if the frame was not stamped
+  int64_t recvNs = Device::rxTimestamp();
+  if (recvNs == 0) recvNs = nowNs();
+  Ip::IpView ipv(buf, len);
+  const u_char* msg = ipv.getPayload();
+  int msgLen = ipv.getPayloadLength();
+  if (msgLen < ICMP_MINLEN) {
+    LOG_WARN("Bad ICMP packet.");
+    return 0;
+  }
+  if (Ip::getChecksum(msg, msgLen) != 0) {
+    LOG_WARN("ICMP checksum error.");
+    return 0;
+  }
+
+  u_char type = msg[0], code = msg[1];
+  switch (type) {
+    case ICMP_ECHO:
+      return echoCallBack(ipv, msg, msgLen);
+    case ICMP_ECHOREPLY:
+      return echoReplyCallBack(ipv, msg, msgLen, recvNs);
+    case ICMP_UNREACH: {
+      if (code == ICMP_UNREACH_NEEDFRAG) return fragNeededCallBack(msg, msgLen);
+      break;
+    }
+    default:
+      break;
+  }
+  return 0;
+}
+
+int sendFragNeeded(const Ip::IpView& ipv, int mtu) {
+  if (isIcmpError(ipv) || (ipv.getOff() & IP_OFFMASK)) return 0;
+
+  ip_addr dst = ipv.getSrc();
+  auto ri = Route::router.lookup(dst);
+  if (ri.ipPrefix.s_addr == 0) {
+    LOG_WARN("No route for %s", Ip::ipToStr(dst).c_str());
+    return -1;
+  }
+
+  // ICMP header, then the header and 8 bytes of data of the packet
+  u_char msg[ICMP_MINLEN + 60 + 8] = {0};
+  int quote = std::min(ipv.getTotalLength(), ipv.getHeaderLength() + 8);
+  uint16_t nextMtu = htons(mtu);
+  msg[0] = ICMP_UNREACH;
+  msg[1] = ICMP_UNREACH_NEEDFRAG;
+  memcpy(msg + 6, &nextMtu, sizeof(uint16_t));
+  memcpy(msg + ICMP_MINLEN, ipv.getPacket(), quote);
+  uint16_t sum = Ip::getChecksum(msg, ICMP_MINLEN + quote);
+  memcpy(msg + 2, &sum, sizeof(uint16_t));
+
+  return Ip::sendIPPacket(ri.dev->getIp(), dst, IPPROTO_ICMP, msg,
+                          ICMP_MINLEN + quote);
+}
+
+int probe(const ip_addr& dst, int count, ProbeStats& stats, int size,
+          int interval, int timeout) {
+  if (count <= 0 || count > 65536 || size < 8 ||
+      size > IP_MAXPACKET - 60 - ICMP_MINLEN) {
+    LOG_ERR("Bad probe arguments.");
+    return -1;
+  }
+  auto ri = Route::router.lookup(dst);
+  if (ri.ipPrefix.s_addr == 0) {
+    LOG_WARN("No route for %s", Ip::ipToStr(dst).c_str());
+    return -1;
+  }
+  ip_addr src = ri.dev->getIp();
+  bool hwTstamp = ri.dev->hasHwTstamp();
+
+  std::lock_guard<std::mutex> probeLck(prober.probe_m);
+  std::unique_lock<std::mutex> lck(prober.m);
+  prober.active = true;
+  ++prober.id;
+  prober.dst = dst;
+  prober.seen.assign(count, false);
+  prober.rtts.clear();
+  uint16_t id = htons(prober.id);
+  lck.unlock();
+
+  stats = ProbeStats();
+  stats.hwTstamp = hwTstamp;
+  std::vector<u_char> msg(ICMP_MINLEN + size);
+  for (int i = 8; i < size; ++i) msg[ICMP_MINLEN + i] = i;
+  for (int i = 0; i < count; ++i) {
+    if (i > 0) std::this_thread::sleep_for(std::chrono::milliseconds(interval));
+    uint16_t seq = htons(i), sum = 0;
+    int64_t sentNs = nowNs();
+    msg[0] = ICMP_ECHO;
+    msg[1] = 0;
+    memcpy(&msg[2], &sum, sizeof(uint16_t));
+    memcpy(&msg[4], &id, sizeof(uint16_t));
+    memcpy(&msg[6], &seq, sizeof(uint16_t));
+    memcpy(&msg[ICMP_MINLEN], &sentNs, sizeof(int64_t));
+    sum = Ip::getChecksum(msg.data(), msg.size());
+    memcpy(&msg[2], &sum, sizeof(uint16_t));
+    if (Ip::sendIPPacket(src, dst, IPPROTO_ICMP, msg.data(), msg.size()) == 0)
+      ++stats.sent;
+  }
+
+  lck.lock();
+  prober.cv.wait_for(lck, std::chrono::milliseconds(timeout), [&] {
+    return static_cast<int>(prober.rtts.size()) == stats.sent;
+  });
+  prober.active = false;
+  std::vector<double> rtts = std::move(prober.rtts);
+  lck.unlock();
+
+  stats.received = rtts.size();
+  if (rtts.empty()) return 0;
+  std::sort(rtts.begin(), rtts.end());
+  double total = 0;
+  for (auto r : rtts) total += r;
+  stats.min = rtts.front();
+  stats.max = rtts.back();
+  stats.avg = total / rtts.size();
+  stats.p50 = percentile(rtts, 0.50);
+  stats.p90 = percentile(rtts, 0.90);
+  stats.p99 = percentile(rtts, 0.99);
+  return stats.received;
+}
+
+}  // namespace Icmp
+
+namespace Printer {
+
+void printProbeStats(const ip_addr& dst, const Icmp::ProbeStats& stats) {
+  double loss =
+      stats.sent ? 100.0 * (stats.sent - stats.received) / stats.sent : 0;
+  printf("--- %s probe: %d sent, %d received, %.1f%% loss\n",
+         Ip::ipToStr(dst).c_str(), stats.sent, stats.received, loss);
+  if (stats.received == 0) return;
+  printf("rtt min/avg/max = %.3f/%.3f/%.3f ms, ", stats.min, stats.avg,
+         stats.max);
+  printf("p50/p90/p99 = %.3f/%.3f/%.3f ms%s\n", stats.p50, stats.p90,
+         stats.p99, stats.hwTstamp ? ", adapter timestamps" : "");
+}
+
+}  // namespace Printer
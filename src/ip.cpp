@@ -1,15 +1,269 @@
 #include "ip.h"
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "checksum.h"
+#include "flow.h"
+#include "forward.h"
+#include "icmp.h"
+#include "ipfrag.h"
+#include "pmtu.h"
+#include "policer.h"
+
 namespace {
 bool sameSubnet(ip_addr src, ip_addr dst, ip_addr mask) {
   return (src.s_addr & mask.s_addr) == (dst.s_addr & mask.s_addr);
 }
+
+// identification of packets sent by me
+std::atomic<uint16_t> nextIpId{0};
+
+// copy the options which should be in every fragment, return the length
+// padded to 4 bytes
+int copiedOptions(const u_char *opt, int optLen, u_char *out) {
+  int n = 0;
+  for (int i = 0; i < optLen;) {
+    u_char type = opt[i];
+    if (type == IPOPT_EOL) break;
+    if (type == IPOPT_NOP) {
+      ++i;
+      continue;
+    }
+    if (i + 1 >= optLen) break;
+    int olen = opt[i + 1];
+    if (olen < 2 || i + olen > optLen) break;
+    if (IPOPT_COPIED(type)) {
+      memcpy(out + n, opt + i, olen);
+      n += olen;
+    }
+    i += olen;
+  }
+  while (n % 4) out[n++] = IPOPT_EOL;
+  return n;
+}
+
+// where to send frames: a MAC address known, or a neighbor to resolve by ARP
+struct Hop {
+  Device::DevicePtr dev;
+  MAC::MacAddr mac;
+  ip_addr neighbor;
+  bool resolve;
+};
+
+// send a frame to the hop, never wait for ARP
+int sendToHop(const Hop &hop, ether_header &hdr, const iovec *iov,
+              int iovcnt) {
+  if (hop.resolve)
+    return Arp::arpMgr.sendFrame(hop.dev, hop.neighbor, hdr, iov, iovcnt);
+  memcpy(hdr.ether_dhost, hop.mac.addr, ETHER_ADDR_LEN);
+  return Device::deviceMgr.sendFrame(hop.dev, hdr, iov, iovcnt);
+}
+
+// copy the header, decrement TTL and patch the checksum, the header stays in
+// network order. Return the length of the header
+int decTtl(const Ip::IpView &ipv, u_char *hdr) {
+  int hl = ipv.getHeaderLength();
+  memcpy(hdr, ipv.getPacket(), hl);
+  auto iph = reinterpret_cast<ip *>(hdr);
+  uint16_t oldWord, newWord;
+  memcpy(&oldWord, &iph->ip_ttl, sizeof(uint16_t));
+  iph->ip_ttl--;
+  memcpy(&newWord, &iph->ip_ttl, sizeof(uint16_t));
+  iph->ip_sum = Ip::updateChecksum(iph->ip_sum, oldWord, newWord);
+  return hl;
+}
+
+// slots of the flow cache of each thread, should be a power of 2
+constexpr int FLOW_CACHE_SIZE = 1024;
+
+// a forwarding decision of a flow: egress device and a prebuilt header
+struct FlowCacheEntry {
+  uint64_t gen = 0;  // 0 for empty slots
+  Flow::FlowKey key;
+  Device::DevicePtr dev;
+  ether_header hdr;
+};
+
+bool sameFlow(const Flow::FlowKey &a, const Flow::FlowKey &b) {
+  return a.src == b.src && a.dst == b.dst && a.sport == b.sport &&
+         a.dport == b.dport && a.proto == b.proto;
+}
+
+// direct-mapped, each forwarding thread has its own
+FlowCacheEntry *flowCache() {
+  thread_local std::unique_ptr<FlowCacheEntry[]> cache(
+      new FlowCacheEntry[FLOW_CACHE_SIZE]);
+  return cache.get();
+}
+
+// split a packet into fragments no longer than mtu and send them, the header
+// is in network order
+int sendFragments(const Hop &hop, const u_char *hdr, const iovec *iov,
+                  int iovcnt, int mtu, uint8_t ttl) {
+  int hl = (hdr[0] & 0xf) * 4;
+  int baseHl = sizeof(ip);
+
+  // header of fragments except the first one
+  u_char restHdr[60];
+  memcpy(restHdr, hdr, baseHl);
+  int restHl =
+      baseHl + copiedOptions(hdr + baseHl, hl - baseHl, restHdr + baseHl);
+
+  uint16_t off = (hdr[6] << 8) | hdr[7];
+  int base = (off & IP_OFFMASK) * 8;
+  bool more = off & IP_MF;
+  int dataLen = 0;
+  for (int i = 0; i < iovcnt; ++i) dataLen += iov[i].iov_len;
+
+  ether_header ehdr;
+  ehdr.ether_type = ETHERTYPE_IP;
+
+  int vi = 0;
+  size_t vo = 0;  // current position in iov
+  for (int pos = 0; pos < dataLen;) {
+    int fhl = pos ? restHl : hl;
+    int chunk = std::min(dataLen - pos, (mtu - fhl) & ~7);
+    if (chunk <= 0) {
+      LOG_ERR("MTU is too small: %d", mtu);
+      return -1;
+    }
+    bool last = (pos + chunk == dataLen);
+
+    u_char fhdr[60];
+    memcpy(fhdr, pos ? restHdr : hdr, fhl);
+    auto iph = reinterpret_cast<ip *>(fhdr);
+    iph->ip_hl = fhl / 4;
+    iph->ip_len = htons(fhl + chunk);
+    iph->ip_off = htons(((base + pos) / 8) | (last && !more ? 0 : IP_MF));
+    iph->ip_ttl = ttl;
+    iph->ip_sum = 0;
+    iph->ip_sum = Ip::getChecksum(iph, fhl);
+
+    // slice the payload, each piece is in a different iovec
+    iovec parts[IP_MAX_IOV + 1];
+    int n = 0;
+    parts[n++] = {fhdr, static_cast<size_t>(fhl)};
+    for (int need = chunk; need > 0;) {
+      while (vo == iov[vi].iov_len) {
+        ++vi;
+        vo = 0;
+      }
+      size_t take = std::min(static_cast<size_t>(need), iov[vi].iov_len - vo);
+      parts[n++] = {static_cast<u_char *>(iov[vi].iov_base) + vo, take};
+      vo += take;
+      need -= take;
+    }
+
+    if (sendToHop(hop, ehdr, parts, n) < 0) return -1;
+    pos += chunk;
+  }
+  return 0;
+}
+
+// the device to send a packet from me and the next hop to dest: the neighbor
+// itself in the same subnet, or one of the gateways chosen by hash
+int resolveHop(const ip_addr &src, const ip_addr &dest, uint32_t hash,
+               Hop &hop) {
+  char tmpipstr[20];
+  // get src device
+  auto dev = Device::deviceMgr.getDevicePtr(src);
+  if (!dev) {
+    Ip::ipToStr(src, tmpipstr);
+    LOG_ERR("No device with ip %s", tmpipstr);
+    return -1;
+  }
+  hop = {dev, MAC::MacAddr(), dest, false};
+
+  // resolve dest mac addr by ARP if in the same subnet
+  if (sameSubnet(src, dest, dev->getSubnetMask())) {
+    hop.resolve = true;
+    return 0;
+  }
+
+  auto ri = Route::router.lookup(dest);
+  if (ri.ipPrefix.s_addr == 0) {
+    Ip::ipToStr(dest, tmpipstr);
+    LOG_ERR("No route for %s", tmpipstr);
+    return -1;
+  }
+  auto &nh = ri.pickHop(hash);
+  hop.dev = nh.dev;
+  hop.mac = nh.mac;
+  return 0;
+}
+
+// flow of a packet sent by me, ports are in the first piece
+Flow::FlowKey localFlowKey(const ip_addr &src, const ip_addr &dest, int proto,
+                          const iovec *iov, int iovcnt) {
+  Flow::FlowKey key = {src.s_addr, dest.s_addr, 0, 0,
+                       static_cast<uint8_t>(proto)};
+  if ((proto == IPPROTO_TCP || proto == IPPROTO_UDP) && iovcnt > 0 &&
+      iov[0].iov_len >= 4) {
+    memcpy(&key.sport, iov[0].iov_base, 2);
+    memcpy(&key.dport, static_cast<u_char *>(iov[0].iov_base) + 2, 2);
+  }
+  return key;
+}
+
+// build a packet from me and send it to the hop, in fragments if it is
+// larger than mtu
+int sendPacket(const Hop &hop, int mtu, const ip_addr &src,
+               const ip_addr &dest, int proto, const iovec *iov, int iovcnt) {
+  Ip::IpPacket ipPack;
+  ipPack.setDefaultHdr();
+  ipPack.hdr.ip_src = src;
+  ipPack.hdr.ip_dst = dest;
+  ipPack.hdr.ip_p = proto;
+  ipPack.hdr.ip_id = nextIpId++;
+  if (ipPack.setData(iov, iovcnt) < 0) return -1;
+
+  // too large for the path: send fragments, and DF should be cleared
+  bool fragment = ipPack.hdr.ip_len > mtu;
+  if (fragment) ipPack.hdr.ip_off = 0;
+
+  ipPack.htonType();
+  ipPack.setChksum();
+  if (fragment)
+    return sendFragments(hop, reinterpret_cast<u_char *>(&ipPack.hdr),
+                         ipPack.iov, ipPack.iovcnt, mtu, ipPack.hdr.ip_ttl);
+
+  // the header and the payload go to the frame directly
+  ether_header ehdr;
+  ehdr.ether_type = ETHERTYPE_IP;
+  iovec parts[IP_MAX_IOV + 1];
+  parts[0] = {&ipPack.hdr, sizeof(ip)};
+  std::copy_n(ipPack.iov, ipPack.iovcnt, parts + 1);
+  return sendToHop(hop, ehdr, parts, ipPack.iovcnt + 1);
+}
+
+// callbacks indexed by protocol number
+std::atomic<IPPacketReceiveCallback> protocolTable[256];
+
+// submit a packet sent to me to the protocol above
+int deliver(const void *buf, int len) {
+  Ip::IpView ipv(buf, len);
+  auto cb = protocolTable[ipv.getProto()].load(std::memory_order_relaxed);
+  if (cb) return cb(buf, len);
+  return Ip::callback ? Ip::callback(buf, len) : 0;
+}
 }  // namespace
 
 namespace Ip {
 
 IPPacketReceiveCallback callback = nullptr;
 
+int setProtocolCallback(uint8_t proto, IPPacketReceiveCallback callback) {
+  protocolTable[proto].store(callback);
+  return 0;
+}
+
 void ipCopy(ip_addr &dst, const ip_addr &src) {
   memcpy(&dst, &src, sizeof(ip_addr));
 }
@@ -27,59 +281,136 @@ void ipToStr(const ip_addr &ip, char *ipstr) {
 
 // this is necessary for a common callback
 int ipCallBack(const void *buf, int len, DeviceId id) {
-  IpPacket ipp((u_char *)buf, len);
-  if (!ipp.chkChksum()) LOG_WARN("Checksum error.");
-  ipp.ntohType();
-  ip_addr dstIp = ipp.hdr.ip_dst;
+  IpView ipv(buf, len);
+  if (!ipv.valid()) {
+    LOG_WARN("Bad IP packet.");
+    return 0;
+  }
+  if (!Policer::policer.admitIp(ipv)) return 0;
+  if (!ipv.chkChksum()) LOG_WARN("Checksum error.");
+  ip_addr dstIp = ipv.getDst();
 
   // is me?
-  if (Device::deviceMgr.haveDeviceWithIp(dstIp)) {
-    if (callback) {
-      return callback(&ipp, len);
+  if (Device::deviceMgr.haveDeviceWithIp(dstIp)) return deliverPacket(ipv);
+
+  if (Forward::engine.running()) return Forward::engine.submit(ipv);
+  return forwardPacket(ipv);
+}
+
+int deliverPacket(const IpView &ipv) {
+  // a fragment: wait for the whole datagram
+  if (ipv.getOff() & (IP_MF | IP_OFFMASK)) {
+    std::vector<u_char> packet;
+    if (IpFrag::reassembler.insert(ipv, packet) <= 0) return 0;
+    return deliver(packet.data(), packet.size());
+  }
+  return deliver(ipv.getPacket(), ipv.getTotalLength());
+}
+
+int forwardPacket(const IpView &ipv) {
+  Flow::FlowKey key;
+  Flow::getFlowKey(ipv.getPacket(), ipv.getTotalLength(), key);
+  uint32_t hash = Flow::hash(key);
+  auto &e = flowCache()[hash & (FLOW_CACHE_SIZE - 1)];
+
+  // read the generation before lookup: a change after it makes the entry
+  // stale at once
+  uint64_t gen = Route::generation;
+  if (e.gen == gen && sameFlow(e.key, key) && ipv.getTtl() > 1 &&
+      ipv.getTotalLength() <= e.dev->getMtu()) {
+    u_char hdr[60];
+    int hl = decTtl(ipv, hdr);
+    iovec parts[2] = {{hdr, static_cast<size_t>(hl)},
+                      {const_cast<u_char *>(ipv.getPayload()),
+                       static_cast<size_t>(ipv.getPayloadLength())}};
+    return e.dev->sendFrame(e.hdr, parts, 2);
+  }
+
+  // lookup routing table -->
+  auto ri = Route::router.lookup(ipv.getDst());
+  if (ri.ipPrefix.s_addr != 0) {
+    Device::DevicePtr dev;
+    MAC::MacAddr mac;
+    bool resolved = true;
+    if (ri.isDev) {
+      dev = ri.dev;
+      resolved = Arp::arpMgr.lookup(ipv.getDst(), mac);
     } else {
-      return 0;
+      auto &nh = ri.pickHop(hash);
+      dev = nh.dev;
+      mac = nh.mac;
+    }
+    if (resolved) {
+      e.gen = gen;
+      e.key = key;
+      e.dev = dev;
+      e.hdr.ether_type = ETHERTYPE_IP;
+      memcpy(e.hdr.ether_dhost, mac.addr, ETHER_ADDR_LEN);
+      dev->getMAC(e.hdr.ether_shost);
     }
   }
+  return forwardPacket(ipv, ri);
+}
 
-  // route it! -->
-  char tmpipstr[20];
-  MAC::MacAddr dstMac;
-  Device::DevicePtr dev;
-  ipToStr(dstIp, tmpipstr);
+int forwardPacket(const IpView &ipv, const Route::RouteItem &ri) {
+  Hop hop;
+  ip_addr dstIp = ipv.getDst();
+
+  if (ipv.getTtl() <= 1) {
+    LOG_WARN("TTL exceeded, drop packet to %s", ipToStr(dstIp).c_str());
+    return 0;
+  }
 
-  // lookup routing table -->
-  Route::RouteItem ri;
-  ri = Route::router.lookup(dstIp);
   if (ri.ipPrefix.s_addr == 0) {
-    LOG_WARN("No route for %s", tmpipstr);
+    LOG_WARN("No route for %s", ipToStr(dstIp).c_str());
     return -1;
   }
 
-  // > in my subnet
+  // > in my subnet: resolve by ARP
   if (ri.isDev) {
-    dev = ri.dev;
-    dstMac = Arp::arpMgr.getMacAddr(dev, dstIp);
-    if (MAC::isBroadcast(dstMac)) {
-      LOG_ERR("MAC address not found in subnet");
-      return -1;
-    }
+    hop = {ri.dev, MAC::MacAddr(), dstIp, true};
   }
 
-  // > route
+  // > route: one of the equal-cost next hops by flow
   else {
-    dev = ri.dev;
-    dstMac = ri.nextHopMac;
-    LOG_INFO("Route to \033[;1m%s\033[0m via \033[33m%s\033[0m", tmpipstr,
-             dev->getName().c_str());
+    Flow::FlowKey key;
+    Flow::getFlowKey(ipv.getPacket(), ipv.getTotalLength(), key);
+    auto &nh = ri.pickHop(Flow::hash(key));
+    hop = {nh.dev, nh.mac, dstIp, false};
+    LOG_INFO("Route to \033[;1m%s\033[0m via \033[33m%s\033[0m",
+             ipToStr(dstIp).c_str(), hop.dev->getName().c_str());
   }
 
-  int packLen = ipp.hdr.ip_len;
-  ipp.htonType();
-  return Device::deviceMgr.sendFrame(&ipp, packLen, ETHERTYPE_IP, dstMac.addr,
-                                     dev);
+  auto &dev = hop.dev;
+  int packLen = ipv.getTotalLength();
+  if (packLen > dev->getMtu()) {
+    if (ipv.getOff() & IP_DF) {
+      LOG_WARN("Packet to %s is too large and cannot be fragmented",
+               ipToStr(dstIp).c_str());
+      return Icmp::sendFragNeeded(ipv, dev->getMtu());
+    }
+    iovec payload = {const_cast<u_char *>(ipv.getPayload()),
+                     static_cast<size_t>(ipv.getPayloadLength())};
+    return sendFragments(hop, ipv.getPacket(), &payload, 1, dev->getMtu(),
+                         ipv.getTtl() - 1);
+  }
+
+  // decrement TTL and patch the checksum in a copy of the header
+  u_char hdr[60];
+  int hl = decTtl(ipv, hdr);
+
+  // the payload is copied only once, into the frame to send
+  ether_header ehdr;
+  ehdr.ether_type = ETHERTYPE_IP;
+  iovec parts[2] = {{hdr, static_cast<size_t>(hl)},
+                    {const_cast<u_char *>(ipv.getPayload()),
+                     static_cast<size_t>(ipv.getPayloadLength())}};
+  return sendToHop(hop, ehdr, parts, 2);
 }
 
-IpPacket::IpPacket(const u_char *buf, int len) { memcpy(&hdr, buf, len); }
+bool IpView::chkChksum() const {
+  return getChecksum(buf, getHeaderLength()) == 0;
+}
 
 void IpPacket::setDefaultHdr() {
   hdr.ip_v = 4;         // version
@@ -91,12 +422,24 @@ void IpPacket::setDefaultHdr() {
 }
 
 int IpPacket::setData(const u_char *buf, int len) {
-  if (len > IP_MAXPACKET - hdr.ip_hl * 4) {
+  iovec v = {const_cast<u_char *>(buf), static_cast<size_t>(len)};
+  return setData(&v, 1);
+}
+
+int IpPacket::setData(const iovec *v, int cnt) {
+  if (cnt > IP_MAX_IOV) {
+    LOG_ERR("too many pieces: %d.", cnt);
+    return -1;
+  }
+  size_t len = 0;
+  for (int i = 0; i < cnt; ++i) len += v[i].iov_len;
+  if (len > IP_MAXPACKET - hdr.ip_hl * 4u) {
     LOG_ERR("packet is to large.");
     return -1;
   }
   hdr.ip_len = len + hdr.ip_hl * 4;
-  memcpy(data, buf, len);
+  std::copy_n(v, cnt, iov);
+  iovcnt = cnt;
   return 0;
 }
 
@@ -126,106 +469,164 @@ void IpPacket::ntohType() {
 
 int sendIPPacket(const ip_addr src, const ip_addr dest, int proto,
                  const void *buf, int len) {
-  char tmpipstr[20];
-  // get src device
-  auto dev = Device::deviceMgr.getDevicePtr(src);
-  if (!dev) {
-    ipToStr(src, tmpipstr);
-    LOG_ERR("No device with ip %s", tmpipstr);
-    return -1;
+  iovec v = {const_cast<void *>(buf), static_cast<size_t>(len)};
+  return sendIPPacket(src, dest, proto, &v, 1);
+}
+
+int sendIPPacket(const ip_addr src, const ip_addr dest, int proto,
+                 const iovec *iov, int iovcnt) {
+  auto key = localFlowKey(src, dest, proto, iov, iovcnt);
+  Hop hop;
+  if (resolveHop(src, dest, Flow::hash(key), hop) < 0) return -1;
+  int mtu = Pmtu::pmtuCache.get(dest, hop.dev->getMtu());
+  return sendPacket(hop, mtu, src, dest, proto, iov, iovcnt);
+}
+
+int sendIPPacket(DstCache &cache, const ip_addr src, const ip_addr dest,
+                 int proto, const iovec *iov, int iovcnt) {
+  // read the generation before resolving: a change after it makes the cache
+  // stale at once
+  uint64_t gen = Route::generation;
+  // an expired path MTU is dropped from the cache lazily, without a new
+  // generation, so its time is checked here
+  if (cache.gen != gen || !(cache.src == src) || !(cache.dst == dest) ||
+      cache.mtuExpire <= std::chrono::steady_clock::now()) {
+    cache.gen = 0;
+    auto key = localFlowKey(src, dest, proto, iov, iovcnt);
+    Hop hop;
+    if (resolveHop(src, dest, Flow::hash(key), hop) < 0) return -1;
+    std::chrono::steady_clock::time_point expire;
+    int mtu = Pmtu::pmtuCache.get(dest, hop.dev->getMtu(), &expire);
+    // not cached until the neighbor is resolved
+    if (hop.resolve && !Arp::arpMgr.lookup(hop.neighbor, hop.mac))
+      return sendPacket(hop, mtu, src, dest, proto, iov, iovcnt);
+
+    cache.gen = gen;
+    cache.src = src;
+    cache.dst = dest;
+    cache.dev = hop.dev;
+    cache.mac = hop.mac;
+    cache.mtu = mtu;
+    cache.mtuExpire = expire;
   }
 
-  MAC::MacAddr dstMac;
+  Hop hop = {cache.dev, cache.mac, dest, false};
+  return sendPacket(hop, cache.mtu, src, dest, proto, iov, iovcnt);
+}
 
-  // get dest mac addr if in the same subnet
-  if (sameSubnet(src, dest, dev->getSubnetMask())) {
-    dstMac = Arp::arpMgr.getMacAddr(dev, dest);
-    if (MAC::isBroadcast(dstMac)) {
-      LOG_ERR("MAC address not found in subnet");
-      return -1;
+int sendIPPackets(const Packet *packets, size_t n) {
+  // group packets by source, destination and flow hash, which choose the
+  // hop, in order of first appearance. The hash is the one of sendIPPacket,
+  // so a flow takes the same hop by both.
+  std::map<std::tuple<in_addr_t, in_addr_t, uint32_t>, size_t> groupOf;
+  std::vector<std::vector<size_t>> groups;
+  std::vector<uint32_t> hashes;
+  for (size_t i = 0; i < n; ++i) {
+    auto &p = packets[i];
+    iovec iov = {const_cast<void *>(p.buf), static_cast<size_t>(p.len)};
+    uint32_t h = Flow::hash(localFlowKey(p.src, p.dst, p.proto, &iov, 1));
+    auto res = groupOf.emplace(std::make_tuple(p.src.s_addr, p.dst.s_addr, h),
+                               groups.size());
+    if (res.second) {
+      groups.emplace_back();
+      hashes.push_back(h);
     }
+    groups[res.first->second].push_back(i);
   }
 
-  // to nexthop (HOW TO DO IT!!!)
-  // wtf... is me?
-  else {
-    auto ri = Route::router.lookup(dest);
-    if (ri.ipPrefix.s_addr == 0) {
-      ipToStr(dest, tmpipstr);
-      LOG_ERR("No route for %s", tmpipstr);
-      return -1;
-    } else {
-      dstMac = ri.nextHopMac;
+  // headers and frames live until all batches are queued
+  std::vector<IpPacket> ipPacks(n);
+  std::vector<std::array<iovec, 2>> parts(n);
+  std::vector<ether_header> ehdrs(groups.size());
+  std::unordered_map<Device::Device *, std::vector<Device::FrameRef>> batches;
+
+  int sent = 0;
+  auto flush = [&](const Device::DevicePtr &dev) {
+    auto &frames = batches[dev.get()];
+    if (frames.empty()) return;
+    if (dev->sendFrames(frames.data(), frames.size()) == 0)
+      sent += frames.size();
+    else
+      LOG_ERR("Sending frames failed on %s.", dev->getName().c_str());
+    frames.clear();
+  };
+
+  std::vector<Device::DevicePtr> devs;
+  for (size_t g = 0; g < groups.size(); ++g) {
+    const Packet &first = packets[groups[g].front()];
+    Hop hop;
+    if (resolveHop(first.src, first.dst, hashes[g], hop) < 0) continue;
+    // a neighbor known now needs no more lookups
+    if (hop.resolve && Arp::arpMgr.lookup(hop.neighbor, hop.mac))
+      hop.resolve = false;
+    int mtu = Pmtu::pmtuCache.get(first.dst, hop.dev->getMtu());
+    if (std::find(devs.begin(), devs.end(), hop.dev) == devs.end())
+      devs.push_back(hop.dev);
+
+    auto &ehdr = ehdrs[g];
+    ehdr.ether_type = ETHERTYPE_IP;
+    memcpy(ehdr.ether_dhost, hop.mac.addr, ETHER_ADDR_LEN);
+    hop.dev->getMAC(ehdr.ether_shost);
+
+    for (size_t i : groups[g]) {
+      auto &p = packets[i];
+      auto &ipPack = ipPacks[i];
+      ipPack.setDefaultHdr();
+      ipPack.hdr.ip_src = p.src;
+      ipPack.hdr.ip_dst = p.dst;
+      ipPack.hdr.ip_p = p.proto;
+      ipPack.hdr.ip_id = nextIpId++;
+      if (ipPack.setData(static_cast<const u_char *>(p.buf), p.len) < 0)
+        continue;
+      bool fragment = ipPack.hdr.ip_len > mtu;
+      if (fragment) ipPack.hdr.ip_off = 0;
+      ipPack.htonType();
+      ipPack.setChksum();
+
+      // fragments and packets waiting for ARP are sent one by one, after the
+      // frames queued before them
+      if (fragment || hop.resolve) {
+        flush(hop.dev);
+        int res;
+        if (fragment) {
+          res = sendFragments(hop, reinterpret_cast<u_char *>(&ipPack.hdr),
+                              ipPack.iov, ipPack.iovcnt, mtu,
+                              ipPack.hdr.ip_ttl);
+        } else {
+          ether_header h = ehdr;
+          iovec v[2] = {{&ipPack.hdr, sizeof(ip)}, ipPack.iov[0]};
+          res = sendToHop(hop, h, v, 2);
+        }
+        if (res == 0) ++sent;
+        continue;
+      }
+      parts[i] = {iovec{&ipPack.hdr, sizeof(ip)}, ipPack.iov[0]};
+      batches[hop.dev.get()].push_back({&ehdr, parts[i].data(), 2});
     }
   }
 
-  // packet
-  Ip::IpPacket ipPack;
-  ipPack.setDefaultHdr();
-  ipPack.hdr.ip_src = src;
-  ipPack.hdr.ip_dst = dest;
-  ipPack.hdr.ip_p = proto;
-  ipPack.setData((u_char *)buf, len);
+  for (auto &dev : devs) flush(dev);
+  return sent;
+}
 
-  int packLen = ipPack.hdr.ip_len;
-  // Printer::printIpPacket(ipPack, true);
+uint16_t combineChecksum(uint16_t a, uint16_t b) {
+  uint32_t sum = static_cast<uint16_t>(~a) + static_cast<uint16_t>(~b);
+  sum = (sum & 0xffff) + (sum >> 16);
+  return ~sum;
+}
 
-  ipPack.htonType();
-  ipPack.setChksum();
-  return Device::deviceMgr.sendFrame(&ipPack, packLen, ETHERTYPE_IP,
-                                     dstMac.addr, dev);
+uint16_t updateChecksum(uint16_t sum, uint16_t oldWord, uint16_t newWord) {
+  // RFC 1624: HC' = ~(~HC + ~m + m')
+  uint32_t acc = static_cast<uint16_t>(~sum);
+  acc += static_cast<uint16_t>(~oldWord);
+  acc += newWord;
+  acc = (acc & 0xffff) + (acc >> 16);
+  acc = (acc & 0xffff) + (acc >> 16);
+  return ~acc;
 }
 
 uint16_t getChecksum(const void *vdata, size_t length) {
-  // Cast the data pointer to one that can be indexed.
-  char *data = (char *)vdata;
-
-  // Initialise the accumulator.
-  uint64_t acc = 0xffff;
-
-  // Handle any partial block at the start of the data.
-  unsigned int offset = ((uintptr_t)data) & 3;
-  if (offset) {
-    size_t count = 4 - offset;
-    if (count > length) count = length;
-    uint32_t word = 0;
-    memcpy(offset + (char *)&word, data, count);
-    acc += ntohl(word);
-    data += count;
-    length -= count;
-  }
-
-  // Handle any complete 32-bit blocks.
-  char *data_end = data + (length & ~3);
-  while (data != data_end) {
-    uint32_t word;
-    memcpy(&word, data, 4);
-    acc += ntohl(word);
-    data += 4;
-  }
-  length &= 3;
-
-  // Handle any partial block at the end of the data.
-  if (length) {
-    uint32_t word = 0;
-    memcpy(&word, data, length);
-    acc += ntohl(word);
-  }
-
-  // Handle deferred carries.
-  acc = (acc & 0xffffffff) + (acc >> 32);
-  while (acc >> 16) {
-    acc = (acc & 0xffff) + (acc >> 16);
-  }
-
-  // If the data began at an odd byte address
-  // then reverse the byte order to compensate.
-  if (offset & 1) {
-    acc = ((acc & 0xff00) >> 8) | ((acc & 0x00ff) << 8);
-  }
-
-  // Return the checksum in network byte order.
-  return htons(~acc);
+  return Checksum::getChecksum(vdata, length);
 }
 
 }  // namespace Ip
@@ -249,4 +650,13 @@ void printIpPacket(const Ip::IpPacket &ipp, bool sender) {
          (sender ? "--" : ">>"), srcIpStr, dstIpStr, ipp.hdr.ip_len,
          ipProtoNameMap[ipp.hdr.ip_p].c_str());
 }
+
+void printIpPacket(const Ip::IpView &ipv, bool sender) {
+  char srcIpStr[20], dstIpStr[20];
+  Ip::ipToStr(ipv.getSrc(), srcIpStr);
+  Ip::ipToStr(ipv.getDst(), dstIpStr);
+  printf("\033[;1m%s IP\033[0m %s -> %s, len = %d, proto: %s\n",
+         (sender ? "--" : ">>"), srcIpStr, dstIpStr, ipv.getTotalLength(),
+         ipProtoNameMap[ipv.getProto()].c_str());
+}
 }  // namespace Printer
\ No newline at end of file
@@ -0,0 +1,160 @@
+#include "ipfrag.h"
+
+namespace IpFrag {
+
+Reassembler reassembler;
+
+int Reassembler::insert(const Ip::IpView& ipv, std::vector<u_char>& packet) {
+  int hl = ipv.getHeaderLength();
+  uint16_t off = ipv.getOff();
+  int start = (off & IP_OFFMASK) * 8;
+  int len = ipv.getPayloadLength();
+  bool more = off & IP_MF;
+
+  if (start + len > IP_MAXPACKET - hl) {
+    LOG_WARN("Fragment out of range, offset: %d, length: %d", start, len);
+    return -1;
+  }
+  // data of fragments except the last one is a multiple of 8 bytes, and a
+  // fragment without data adds nothing but an entry to hold
+  if (len == 0 || (more && len % 8)) {
+    LOG_WARN("Bad fragment length: %d", len);
+    return -1;
+  }
+
+  FragKey key{ipv.getSrc().s_addr, ipv.getDst().s_addr, ipv.getId(),
+              ipv.getProto()};
+  std::lock_guard<std::mutex> lck(m);
+  auto now = Clock::now();
+  expire(now);
+
+  auto iter = datagrams.find(key);
+  Datagram* found = iter == datagrams.end() ? nullptr : &iter->second;
+
+  // the last fragment gives the length, which should agree with others
+  int end = start + len;
+  if (found) {
+    bool bad = found->totalLen >= 0 && (more ? end > found->totalLen
+                                             : end != found->totalLen);
+    if (!more && !found->pieces.empty()) {
+      auto& last = *found->pieces.rbegin();
+      bad = bad || last.first + static_cast<int>(last.second.size()) > end;
+    }
+    if (bad) {
+      LOG_WARN("Inconsistent fragments, drop datagram %d", key.id);
+      drop(key);
+      return -1;
+    }
+  }
+
+  // the most it may cost: one piece for each gap between the pieces it covers
+  size_t need = len + IPFRAG_PIECE_COST;
+  if (found) {
+    for (auto p = found->pieces.lower_bound(start);
+         p != found->pieces.end() && p->first < end; ++p)
+      need += IPFRAG_PIECE_COST;
+  } else {
+    need += IPFRAG_DATAGRAM_COST;
+  }
+
+  // make room by dropping the oldest datagrams
+  while (memUsed + need > IPFRAG_MEM_LIMIT && !order.empty() &&
+         !(order.front() == key))
+    drop(order.front());
+  if (memUsed + need > IPFRAG_MEM_LIMIT) {
+    LOG_WARN("Reassembly memory exhausted, drop datagram %d", key.id);
+    drop(key);
+    return -1;
+  }
+
+  if (!found) {
+    order.push_back(key);
+    found = &datagrams.emplace(key, Datagram()).first->second;
+    found->expire = now + std::chrono::seconds(IPFRAG_TIME_OUT);
+    found->order = std::prev(order.end());
+    found->mem = IPFRAG_DATAGRAM_COST;
+    memUsed += IPFRAG_DATAGRAM_COST;
+  }
+  auto& dg = *found;
+  if (!more) dg.totalLen = end;
+
+  if (start == 0 && dg.hdr.empty())
+    dg.hdr.assign(ipv.getPacket(), ipv.getPacket() + hl);
+  addPiece(dg, start, ipv.getPayload(), len);
+
+  if (dg.totalLen >= 0 && dg.recvLen == dg.totalLen && !dg.hdr.empty()) {
+    build(dg, packet);
+    drop(key);
+    return 1;
+  }
+  return 0;
+}
+
+size_t Reassembler::getMemUsed() {
+  std::lock_guard<std::mutex> lck(m);
+  return memUsed;
+}
+
+void Reassembler::drop(const FragKey& key) {
+  auto iter = datagrams.find(key);
+  if (iter == datagrams.end()) return;
+  memUsed -= iter->second.mem;
+  order.erase(iter->second.order);
+  datagrams.erase(iter);
+}
+
+void Reassembler::expire(Clock::time_point now) {
+  // all datagrams live for the same time, so the oldest expires first
+  while (!order.empty()) {
+    auto iter = datagrams.find(order.front());
+    if (iter->second.expire > now) break;
+    LOG_WARN("Reassembly timeout, drop datagram %d", iter->first.id);
+    drop(iter->first);
+  }
+}
+
+int Reassembler::addPiece(Datagram& dg, int off, const u_char* data, int len) {
+  auto& pieces = dg.pieces;
+  int pos = off, end = off + len, added = 0;
+
+  // skip bytes covered by the piece before
+  auto iter = pieces.upper_bound(pos);
+  if (iter != pieces.begin()) {
+    auto prev = std::prev(iter);
+    pos = std::max(pos, prev->first + static_cast<int>(prev->second.size()));
+  }
+
+  // fill the gaps between following pieces
+  while (pos < end) {
+    iter = pieces.lower_bound(pos);
+    int stop = (iter == pieces.end()) ? end : std::min(end, iter->first);
+    if (stop > pos) {
+      pieces.emplace(pos, std::vector<u_char>(data + (pos - off),
+                                              data + (stop - off)));
+      added += stop - pos;
+      dg.mem += stop - pos + IPFRAG_PIECE_COST;
+      memUsed += stop - pos + IPFRAG_PIECE_COST;
+    }
+    if (iter == pieces.end() || iter->first >= end) break;
+    pos = iter->first + static_cast<int>(iter->second.size());
+  }
+
+  dg.recvLen += added;
+  return added;
+}
+
+void Reassembler::build(const Datagram& dg, std::vector<u_char>& packet) {
+  int hl = dg.hdr.size();
+  packet.resize(hl + dg.totalLen);
+  memcpy(packet.data(), dg.hdr.data(), hl);
+  for (auto& p : dg.pieces)
+    memcpy(packet.data() + hl + p.first, p.second.data(), p.second.size());
+
+  auto hdr = reinterpret_cast<ip*>(packet.data());
+  hdr->ip_len = htons(packet.size());
+  hdr->ip_off = htons(ntohs(hdr->ip_off) & IP_DF);
+  hdr->ip_sum = 0;
+  hdr->ip_sum = Ip::getChecksum(hdr, hl);
+}
+
+}  // namespace IpFrag
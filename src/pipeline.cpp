@@ -0,0 +1,114 @@
+#include "pipeline.h"
+
+namespace {
+
+// IP packets of a batch
+struct PacketVector {
+  const u_char* buf[RX_BATCH_SIZE];
+  int len[RX_BATCH_SIZE];
+  int64_t ts[RX_BATCH_SIZE];  // capture time of the frame
+  int cnt = 0;
+
+  void push(const u_char* b, int l, int64_t t) {
+    buf[cnt] = b;
+    len[cnt] = l;
+    ts[cnt] = t;
+    ++cnt;
+  }
+
+  void prefetch(int i) const {
+    if (i < cnt) __builtin_prefetch(buf[i]);
+  }
+};
+
+// stages 2 to 5 on the IP packets classified
+int processIp(const PacketVector& pkts) {
+  PacketVector local, fwd;
+  int res = 0;
+
+  // 2. IP validate, and 3. local or forward
+  ip_addr lastDst;
+  bool lastLocal = false, haveLast = false;
+  for (int i = 0; i < pkts.cnt; ++i) {
+    pkts.prefetch(i + 1);
+    Ip::IpView ipv(pkts.buf[i], pkts.len[i]);
+    if (!ipv.valid()) {
+      LOG_WARN("Bad IP packet.");
+      continue;
+    }
+    if (!Policer::policer.admitIp(ipv)) continue;
+    if (!ipv.chkChksum()) LOG_WARN("Checksum error.");
+
+    ip_addr dst = ipv.getDst();
+    if (!haveLast || !(dst == lastDst)) {
+      lastDst = dst;
+      lastLocal = Device::deviceMgr.haveDeviceWithIp(dst);
+      haveLast = true;
+    }
+    (lastLocal ? local : fwd).push(pkts.buf[i], pkts.len[i], pkts.ts[i]);
+  }
+
+  // 4. forward through the flow cache, or queue to forwarding workers
+  bool toWorkers = Forward::engine.running();
+  for (int i = 0; i < fwd.cnt; ++i) {
+    fwd.prefetch(i + 1);
+    Ip::IpView ipv(fwd.buf[i], fwd.len[i]);
+    int r = toWorkers ? Forward::engine.submit(ipv) : Ip::forwardPacket(ipv);
+    if (r < 0) res = -1;
+  }
+
+  // 5. L4 demux
+  for (int i = 0; i < local.cnt; ++i) {
+    local.prefetch(i + 1);
+    Ip::IpView ipv(local.buf[i], local.len[i]);
+    Device::setRxTimestamp(local.ts[i]);
+    if (Ip::deliverPacket(ipv) < 0) res = -1;
+  }
+  Device::setRxTimestamp(0);
+  return res;
+}
+
+int processChunk(const RxFrame* frames, int n) {
+  PacketVector pkts;
+  int res = 0;
+
+  // 1. L2 classify
+  for (int i = 0; i < n; ++i) {
+    if (i + 1 < n) __builtin_prefetch(frames[i + 1].buf);
+    Ether::EtherView frame(frames[i].buf, frames[i].len);
+    if (!frame.valid()) {
+      LOG(ERR, "bad packet length: %d", frames[i].len);
+      continue;
+    }
+    if (frame.getType() != ETHERTYPE_IP) {
+      // IP packets before it go first, so frames keep their order
+      if (processIp(pkts) < 0) res = -1;
+      pkts.cnt = 0;
+      Device::setRxTimestamp(frames[i].ts);
+      if (Device::callback &&
+          Device::callback(frames[i].buf, frames[i].len, frames[i].id) < 0)
+        res = -1;
+      Device::setRxTimestamp(0);
+      continue;
+    }
+    if (Device::deviceMgr.acceptFrame(frames[i].id, frame) < 0) continue;
+    pkts.push(frame.getPayload(), frame.getPayloadLength(), frames[i].ts);
+  }
+
+  if (processIp(pkts) < 0) res = -1;
+  return res;
+}
+
+}  // namespace
+
+namespace Pipeline {
+
+int processBatch(const RxFrame* frames, int n) {
+  int res = 0;
+  for (int i = 0; i < n; i += RX_BATCH_SIZE) {
+    if (processChunk(frames + i, std::min(n - i, RX_BATCH_SIZE)) < 0) res = -1;
+  }
+  return res;
+}
+
+}  // namespace Pipeline
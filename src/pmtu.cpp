@@ -0,0 +1,55 @@
+#include "pmtu.h"
+
+#include "router.h"
+
+namespace {
+// plateau table of RFC 1191, used when a router does not report its MTU
+constexpr int plateaus[] = {32000, 17914, 8166, 4352, 2002, 1492,
+                            1006,  508,   296,  68};
+}  // namespace
+
+namespace Pmtu {
+
+PmtuCache pmtuCache;
+
+int PmtuCache::get(const ip_addr& dst, int devMtu, Clock::time_point* expire) {
+  if (expire) *expire = Clock::time_point::max();
+  std::lock_guard<std::mutex> lck(m);
+  auto iter = entries.find(dst);
+  if (iter == entries.end()) return devMtu;
+  if (iter->second.expire <= Clock::now()) {
+    entries.erase(iter);
+    return devMtu;
+  }
+  if (iter->second.mtu >= devMtu) return devMtu;
+  if (expire) *expire = iter->second.expire;
+  return iter->second.mtu;
+}
+
+int PmtuCache::update(const ip_addr& dst, int mtu, int packLen) {
+  // old routers leave the field zero: guess the next plateau
+  if (mtu == 0) {
+    for (auto p : plateaus) {
+      if (p < packLen) {
+        mtu = p;
+        break;
+      }
+    }
+  }
+  if (mtu < PMTU_MIN) mtu = PMTU_MIN;
+
+  std::lock_guard<std::mutex> lck(m);
+  auto now = Clock::now();
+  auto iter = entries.find(dst);
+  if (iter != entries.end() && iter->second.expire > now &&
+      iter->second.mtu <= mtu)
+    return iter->second.mtu;
+
+  entries[dst] = {mtu, now + std::chrono::seconds(PMTU_TIME_OUT)};
+  // destinations cached with the old MTU
+  ++Route::generation;
+  LOG_INFO("Path MTU to %s: %d", inet_ntoa(dst), mtu);
+  return mtu;
+}
+
+}  // namespace Pmtu
@@ -0,0 +1,165 @@
+#include "policer.h"
+
+#include <netinet/tcp.h>
+
+namespace {
+uint64_t nowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// spread keys such as addresses of one subnet over the buckets
+uint32_t mix(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352d;
+  x ^= x >> 15;
+  x *= 0x846ca68b;
+  x ^= x >> 16;
+  return x;
+}
+
+const char* classNames[] = {"ARP", "ICMP", "TCP SYN", "TCP", "UDP", "OTHER"};
+}  // namespace
+
+namespace Policer {
+
+Policer policer;
+
+int Policer::setLimit(Limit& l, uint32_t rate, uint32_t burst) {
+  uint64_t interval = rate ? 1000000000ull / rate : 0;
+  if (rate && interval == 0) {
+    LOG_ERR("Rate is too large: %u", rate);
+    return -1;
+  }
+  l.tolerance = interval * burst;
+  l.interval = interval;
+  return 0;
+}
+
+int Policer::setClassRate(Class c, uint32_t rate, uint32_t burst) {
+  if (c < Class::ARP || c >= Class::COUNT) return -1;
+  return setLimit(classes[static_cast<int>(c)].classLimit, rate, burst);
+}
+
+int Policer::setSourceRate(Class c, uint32_t rate, uint32_t burst) {
+  if (c < Class::ARP || c >= Class::COUNT) return -1;
+  return setLimit(classes[static_cast<int>(c)].sourceLimit, rate, burst);
+}
+
+bool Policer::take(std::atomic<uint64_t>& tat, const Limit& l, uint64_t now) {
+  uint64_t interval = l.interval.load(std::memory_order_relaxed);
+  if (interval == 0) return true;
+  uint64_t tolerance = l.tolerance.load(std::memory_order_relaxed);
+
+  // GCRA: accept if the next arrival is expected no later than a burst from
+  // now, then push it back by one interval
+  uint64_t t = tat.load(std::memory_order_relaxed);
+  while (true) {
+    uint64_t base = std::max(t, now);
+    if (base - now > tolerance) return false;
+    if (tat.compare_exchange_weak(t, base + interval,
+                                  std::memory_order_relaxed))
+      return true;
+  }
+}
+
+bool Policer::admit(Class c, uint32_t source) {
+  auto& cs = classes[static_cast<int>(c)];
+  bool classLimited = cs.classLimit.interval.load(std::memory_order_relaxed);
+  bool sourceLimited = cs.sourceLimit.interval.load(std::memory_order_relaxed);
+  if (!classLimited && !sourceLimited) {
+    cs.passed.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  uint64_t now = nowNs();
+  if (sourceLimited) {
+    auto& b = cs.sources[mix(source) & (POLICER_SOURCES - 1)];
+    if (b.source.load(std::memory_order_relaxed) != source) {
+      b.source.store(source, std::memory_order_relaxed);
+      b.tat.store(0, std::memory_order_relaxed);
+    }
+    if (!take(b.tat, cs.sourceLimit, now)) {
+      cs.droppedBySource.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+  if (classLimited && !take(cs.tat, cs.classLimit, now)) {
+    cs.droppedByClass.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+  cs.passed.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool Policer::admitArp(const Ether::EtherView& frame) {
+  // the sender hardware address follows the fixed header
+  if (frame.getPayloadLength() < static_cast<int>(sizeof(Arp::ArpFrame)))
+    return admit(Class::ARP, 0);
+  const u_char* mac = frame.getPayload() + sizeof(arphdr);
+  uint32_t source = (mac[2] << 24 | mac[3] << 16 | mac[4] << 8 | mac[5]) ^
+                    (mac[0] << 8 | mac[1]);
+  return admit(Class::ARP, source);
+}
+
+bool Policer::admitIp(const Ip::IpView& ipv) {
+  Class c;
+  switch (ipv.getProto()) {
+    case IPPROTO_ICMP:
+      c = Class::ICMP;
+      break;
+    case IPPROTO_UDP:
+      c = Class::UDP;
+      break;
+    case IPPROTO_TCP: {
+      // flags are in the first fragment only
+      c = Class::TCP;
+      const u_char* seg = ipv.getPayload();
+      if ((ipv.getOff() & IP_OFFMASK) == 0 && ipv.getPayloadLength() > 13 &&
+          (seg[13] & (TH_SYN | TH_ACK)) == TH_SYN)
+        c = Class::TCP_SYN;
+      break;
+    }
+    default:
+      c = Class::OTHER;
+  }
+  return admit(c, ipv.getSrc().s_addr);
+}
+
+Counters Policer::getCounters(Class c) {
+  auto& cs = classes[static_cast<int>(c)];
+  return {cs.passed.load(), cs.droppedByClass.load(),
+          cs.droppedBySource.load()};
+}
+
+void Policer::resetCounters() {
+  for (auto& cs : classes) {
+    cs.passed = 0;
+    cs.droppedByClass = 0;
+    cs.droppedBySource = 0;
+  }
+}
+
+const char* className(Class c) {
+  if (c < Class::ARP || c >= Class::COUNT) return "UNKNOWN";
+  return classNames[static_cast<int>(c)];
+}
+
+}  // namespace Policer
+
+namespace Printer {
+
+void printPolicerCounters() {
+  printf("class       passed      dropped(class)  dropped(source)\n");
+  for (int i = 0; i < static_cast<int>(Policer::Class::COUNT); ++i) {
+    auto c = static_cast<Policer::Class>(i);
+    auto cnt = Policer::policer.getCounters(c);
+    printf("%-10s  %-10lu  %-14lu  %lu\n", Policer::className(c),
+           static_cast<unsigned long>(cnt.passed),
+           static_cast<unsigned long>(cnt.droppedByClass),
+           static_cast<unsigned long>(cnt.droppedBySource));
+  }
+}
+
+}  // namespace Printer
@@ -0,0 +1,81 @@
+#include "rcu.h"
+
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "type.h"
+
+namespace {
+// slots taken by this thread, given back when the thread exits
+struct Registrations {
+  std::vector<std::pair<std::atomic<bool>*, int>> slots;
+  std::vector<const void*> domains;
+
+  ~Registrations() {
+    for (auto& s : slots)
+      if (s.first) s.first->store(false);
+  }
+};
+
+thread_local Registrations registrations;
+}  // namespace
+
+namespace Rcu {
+
+Domain domain;
+
+int Domain::getSlot() {
+  auto& r = registrations;
+  for (size_t i = 0; i < r.domains.size(); ++i)
+    if (r.domains[i] == this) return r.slots[i].second;
+
+  int index = -1;
+  for (int i = 0; i < RCU_MAX_THREADS; ++i) {
+    bool expected = false;
+    if (slots[i].used.compare_exchange_strong(expected, true)) {
+      index = i;
+      break;
+    }
+  }
+  if (index < 0) LOG_WARN("No RCU slot is free, readers slow down writers.");
+  r.domains.push_back(this);
+  r.slots.emplace_back(index < 0 ? nullptr : &slots[index].used, index);
+  return index;
+}
+
+void Domain::readLock() {
+  int i = getSlot();
+  if (i < 0) {
+    overflow.fetch_add(1);
+    return;
+  }
+  slots[i].epoch.store(epoch.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+  // the slot should be seen by writers before any data is read
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void Domain::readUnlock() {
+  int i = getSlot();
+  if (i < 0) {
+    overflow.fetch_sub(1);
+    return;
+  }
+  slots[i].epoch.store(0, std::memory_order_release);
+}
+
+void Domain::synchronize() {
+  // data replaced before it is not seen by sections entered after it
+  uint64_t e = epoch.fetch_add(1) + 1;
+  for (auto& s : slots) {
+    while (true) {
+      uint64_t se = s.epoch.load();
+      if (se == 0 || se >= e) break;
+      std::this_thread::yield();
+    }
+  }
+  while (overflow.load() != 0) std::this_thread::yield();
+}
+
+}  // namespace Rcu
@@ -1,9 +1,19 @@
 #include "router.h"
 
+#include <algorithm>
+
 namespace SDP {
 
 int sdpCallBack(const void* buf, int len, DeviceId id) {
+  if (len < SDPP_SIZE(0)) {
+    LOG_WARN("Bad SDP packet.");
+    return 0;
+  }
   uint8_t pLen = ((uint8_t*)buf)[0];
+  if (len < SDPP_SIZE(pLen)) {
+    LOG_WARN("Bad SDP packet.");
+    return 0;
+  }
   DEFINE_SDPPACKET(sdppGet, pLen);
   memcpy(&sdppGet, buf, SDPP_SIZE(pLen));
   // Printer::printSDP(sdppGet);
@@ -18,8 +28,12 @@ int sdpCallBack(const void* buf, int len, DeviceId id) {
                           (data.itemFlag & SDP_ITEMFLAG_DEL ? true : false)));
   }
 
+  // frames of an advertisement are applied together after the last one
+  MAC::MacAddr mac(sdppGet.mac);
+  if (sdpMgr.reassemble(id, mac, sdppGet.flag, sis) == 0) return 0;
+
   // update routing table
-  Route::router.update(sis, MAC::MacAddr(sdppGet.mac),
+  Route::router.update(sis, mac,
                        Device::deviceMgr.getDevicePtr(id));
 
   // if receive an frame with "isnew" flag
@@ -36,18 +50,98 @@ int sdpCallBack(const void* buf, int len, DeviceId id) {
 namespace Route {
 
 Router router;
+std::atomic<uint64_t> generation{1};
+
+uint64_t routeKey(const ip_addr& prefix, const ip_addr& mask) {
+  return static_cast<uint64_t>(ntohl(prefix.s_addr & mask.s_addr)) << 8 |
+         maskToPflen(mask);
+}
+
+std::shared_ptr<const RoutingTable> Router::getTable() {
+  std::lock_guard<std::mutex> lck(table_m);
+  if (stale) {
+    snapshot = std::make_shared<RoutingTable>(table);
+    stale = false;
+  }
+  return snapshot;
+}
+
+void Router::publish() {
+  stale = true;
+  if (changed.empty()) return;
+  syncFib();
+  ++generation;
+}
+
+void Router::syncFib() {
+  std::sort(changed.begin(), changed.end());
+  changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+  std::vector<const RouteItem*> retired;
+  std::vector<uint32_t> retiredIds;
+  for (auto key : changed) {
+    uint32_t prefix = key >> 8;
+    int depth = key & 0xff;
+    auto item = table.find(key);
+    auto iter = ids.find(key);
+
+    // deleted
+    if (item == table.end()) {
+      if (iter == ids.end()) continue;
+      fib.del(prefix, depth);
+      retired.push_back(routes[iter->second].exchange(nullptr));
+      retiredIds.push_back(iter->second);
+      ids.erase(iter);
+      continue;
+    }
+
+    // changed
+    auto& ri = item->second;
+    if (iter != ids.end()) {
+      retired.push_back(routes[iter->second].exchange(new RouteItem(ri)));
+      continue;
+    }
+
+    // added
+    uint32_t id;
+    if (!freeIds.empty()) {
+      id = freeIds.back();
+      freeIds.pop_back();
+    } else if (nextId < ROUTE_MAX_ITEMS) {
+      id = nextId++;
+    } else {
+      LOG_ERR("Too many routing items, %s/%d is not added.",
+              inet_ntoa(ri.ipPrefix), depth);
+      continue;
+    }
+    // the item is seen before the prefix leads to it
+    routes[id].store(new RouteItem(ri));
+    if (fib.add(prefix, depth, id) < 0) {
+      LOG_ERR("FIB is full, %s/%d is not added.", inet_ntoa(ri.ipPrefix),
+              depth);
+      retired.push_back(routes[id].exchange(nullptr));
+      retiredIds.push_back(id);
+      continue;
+    }
+    ids.emplace(key, id);
+  }
+  changed.clear();
+
+  // one grace period for the whole batch, then nobody reads the old ones
+  Rcu::domain.synchronize();
+  for (auto ri : retired) delete ri;
+  freeIds.insert(freeIds.end(), retiredIds.begin(), retiredIds.end());
+  fib.reclaim();
+}
 
 RouteItem Router::lookup(const ip_addr& ip) {
+  Rcu::ReadGuard guard;
+  uint32_t id = fib.lookup(ntohl(ip.s_addr));
+  const RouteItem* ri =
+      id == FIB_NONE ? nullptr : routes[id].load(std::memory_order_acquire);
+  if (ri) return *ri;
   RouteItem resRi;
-  Device::DevicePtr dev = nullptr;
-  MAC::MacAddr mac;
   resRi.ipPrefix.s_addr = 0;
-  for (auto& ri : table) {
-    if (ri.haveIp(ip)) {
-      resRi = ri;
-      break;
-    }
-  }
   return resRi;
 }
 
@@ -61,10 +155,17 @@ int Router::addItem(const RouteItem& ri) {
 }
 
 void Router::init() {
+  std::unique_lock<std::mutex> lck(table_m);
   for (auto& d : Device::deviceMgr.devices) {
-    table.insert(RouteItem(d->getIp(), d->getSubnetMask(), d, d->getMAC(), 0,
-                           true, SDP_METRIC_NODEL));
+    if (d->isSlave()) continue;
+    auto key = routeKey(d->getIp(), d->getSubnetMask());
+    if (table.emplace(key, RouteItem(d->getIp(), d->getSubnetMask(), d,
+                                     d->getMAC(), 0, true, SDP_METRIC_NODEL))
+            .second)
+      touch(key);
   }
+  publish();
+  lck.unlock();
   // Printer::printRouteTable();
   sendRoutingTable(SDPFLAG_ISNEW, {}, {});
   loopThread = std::thread([&]() { this->routerWorkingLoop(); });
@@ -76,7 +177,8 @@ void Router::sendRoutingTable(int flag,
                               std::optional<MAC::MacAddr> toMac) {
   SDP::SDPItemVector sis;
 
-  for (auto& ri : table) {
+  auto t = getTable();
+  for (auto& [key, ri] : *t) {
     if ((ri.metric >= 0 && ri.metric < SDP_METRIC_TIMEOUT) ||
         ri.metric == SDP_METRIC_NODEL)
       sis.push_back(SDP::SDPItem(ri.ipPrefix, ri.subNetMask, ri.dist, false));
@@ -93,59 +195,103 @@ void Router::sendRoutingTable(int flag,
 void Router::update(const SDP::SDPItemVector& sis, const MAC::MacAddr mac,
                     const Device::DevicePtr dev) {
   SDP::SDPItemVector updateSis;
+  std::unique_lock<std::mutex> lck(table_m);
 
   for (auto& si : sis) {
     auto prefix = si.ipPrefix;
     auto mask = si.subNetMask;
     int dist = si.dist;
     bool del = si.toDel;
+    auto key = routeKey(prefix, mask);
+
+    auto iter = table.find(key);
+    // else add to the router
+    if (iter == table.end()) {
+      if (!del) {
+        table.emplace(key, RouteItem(prefix, mask, dev, mac, dist, false, 0));
+        touch(key);
+        updateSis.push_back(SDP::SDPItem(prefix, mask, dist, false));
+      } else {
+        LOG_ERR("Get a Delete Item but not in the routing table.");
+      }
+      continue;
+    }
 
-    bool handled = false;
     // already exist
-    for (auto& ri : table) {
-      if (prefix == ri.ipPrefix && mask == ri.subNetMask) {
-        // from the same device: update metric
-        if (mac == ri.nextHopMac) {
-          if (del) {
-            ri.metric = SDP_METRIC_TIMEOUT;
-            updateSis.push_back(SDP::SDPItem(prefix, mask, dist, true));
-          } else {
-            ri.metric = 0;
-          }
-        }
-        // TIMEOUT yet: do nothing
-        else if (ri.metric == SDP_METRIC_TIMEOUT) {
-          // nothing
+    auto& ri = iter->second;
+    auto hop = ri.findHop(mac);
+    // from a next hop: update metric
+    if (hop) {
+      if (del || (dist > ri.dist && ri.hopCnt > 1)) {
+        // the last hop: delete the item, or leave the equal-cost set
+        if (ri.hopCnt == 1) {
+          ri.metric = SDP_METRIC_TIMEOUT;
+          updateSis.push_back(SDP::SDPItem(prefix, mask, dist, true));
+        } else {
+          ri.delHop(mac);
+          touch(key);
         }
-        // from a better device: update all
-        else if (dist < ri.dist && !del) {
-          ri.nextHopMac = mac;
-          ri.dev = dev;
-          ri.dist = dist;
-          ri.metric = 0;
-          updateSis.push_back(SDP::SDPItem(prefix, mask, dist, false));
-        }
-        handled = true;
-        break;
+      } else if (dist < ri.dist) {
+        ri.setHop(dev, mac);
+        ri.dist = dist;
+        ri.metric = 0;
+        touch(key);
+        updateSis.push_back(SDP::SDPItem(prefix, mask, dist, false));
+      } else {
+        hop->metric = 0;
+        ri.metric = 0;
       }
     }
-    if (handled) continue;
-
-    // else add to the router
-    if (!del) {
-      table.insert(RouteItem(prefix, mask, dev, mac, dist, false, 0));
+    // TIMEOUT yet: do nothing
+    else if (ri.metric == SDP_METRIC_TIMEOUT) {
+      // nothing
+    }
+    // from a better device: update all
+    else if (dist < ri.dist && !del) {
+      ri.setHop(dev, mac);
+      ri.dist = dist;
+      ri.metric = 0;
+      touch(key);
       updateSis.push_back(SDP::SDPItem(prefix, mask, dist, false));
-    } else {
-      LOG_ERR("Get a Delete Item but not in the routing table.");
+    }
+    // from another device as good: one more next hop
+    else if (dist == ri.dist && !del && !ri.isDev) {
+      if (ri.addHop(dev, mac)) {
+        ri.metric = 0;
+        touch(key);
+      }
     }
   }
 
+  publish();
+  lck.unlock();
+
   // LOG_INFO("Update routing items: %zu", updateSis.size());
   if (updateSis.size() == 0) return;
   // Printer::printRouteTable();
   SDP::sdpMgr.sendSDPPackets(updateSis, SDPFLAG_INCREMENT, dev);
 }
 
+void Router::rebindDevice(const Device::DevicePtr& from,
+                          const Device::DevicePtr& to) {
+  std::lock_guard<std::mutex> lck(table_m);
+  for (auto& [key, ri] : table) {
+    bool moved = false;
+    if (ri.dev == from) {
+      ri.dev = to;
+      moved = true;
+    }
+    for (int i = 0; i < ri.hopCnt; ++i) {
+      if (ri.nextHops[i].dev == from) {
+        ri.nextHops[i].dev = to;
+        moved = true;
+      }
+    }
+    if (moved) touch(key);
+  }
+  publish();
+}
+
 void Router::routerWorkingLoop() {
   while (true) {
     std::this_thread::sleep_for(
@@ -155,26 +301,39 @@ void Router::routerWorkingLoop() {
 
     // update metric
     SDP::SDPItemVector updateSis;
+    std::unique_lock<std::mutex> lck(table_m);
     for (auto iter = table.begin(); iter != table.end();) {
+      auto& ri = iter->second;
       // delete a dead item
-      if (iter->metric == SDP_METRIC_DIE) {
+      if (ri.metric == SDP_METRIC_DIE) {
+        touch(iter->first);
         iter = table.erase(iter);
       }
       // ready to delete a item with large matric
-      else if (iter->metric >= SDP_METRIC_TIMEOUT) {
-        iter->metric = SDP_METRIC_DIE;
+      else if (ri.metric >= SDP_METRIC_TIMEOUT) {
+        ri.metric = SDP_METRIC_DIE;
         updateSis.push_back(
-            SDP::SDPItem(iter->ipPrefix, iter->subNetMask, iter->dist, true));
+            SDP::SDPItem(ri.ipPrefix, ri.subNetMask, ri.dist, true));
         ++iter;
       }
       // won't change
-      else if (iter->metric == SDP_METRIC_NODEL) {
+      else if (ri.metric == SDP_METRIC_NODEL) {
         ++iter;
       } else {
-        iter->metric += 1;
+        ri.metric += 1;
+        // age next hops, a silent one leaves if others are alive
+        for (int i = ri.hopCnt - 1; i >= 0; --i) {
+          auto& hop = ri.nextHops[i];
+          if (++hop.metric >= SDP_METRIC_TIMEOUT && ri.hopCnt > 1) {
+            ri.delHop(hop.mac);
+            touch(iter->first);
+          }
+        }
         ++iter;
       }
     }
+    publish();
+    lck.unlock();
     // Printer::printRouteTable();
     SDP::sdpMgr.sendSDPPackets(updateSis, 0);
   }
@@ -188,14 +347,24 @@ void printRouteItem(const Route::RouteItem& r) {
          Route::maskToPflen(r.subNetMask),
          MAC::toString(r.nextHopMac.addr).c_str(), r.dev->getName().c_str(),
          (r.isDev ? "dev" : "via"), r.dist, r.metric);
+  // other equal-cost next hops
+  for (int i = 1; i < r.hopCnt; ++i) {
+    auto& hop = r.nextHops[i];
+    printf("  \t\t%s\t%s\tvia(%d)>%d\n", MAC::toString(hop.mac.addr).c_str(),
+           hop.dev->getName().c_str(), r.dist, hop.metric);
+  }
 }
 void printRouteTable() {
   printf(
       "\n========================= Routing Table "
       "=========================\n");
-  for (auto& r : Route::router.table) {
-    Printer::printRouteItem(r);
-  }
+  // longest prefixes first
+  auto t = Route::router.getTable();
+  std::vector<const Route::RouteItem*> items;
+  for (auto& [key, ri] : *t) items.push_back(&ri);
+  std::sort(items.begin(), items.end(),
+            [](auto a, auto b) { return *a < *b; });
+  for (auto r : items) Printer::printRouteItem(*r);
   printf(
       "==========================================="
       "======================\n\n");
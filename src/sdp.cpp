@@ -1,5 +1,7 @@
 #include "sdp.h"
 
+#include "flow.h"
+
 namespace Route {
 
 RouteItem::RouteItem(const ip_addr& _ip, const ip_addr& _mask,
@@ -12,6 +14,7 @@ RouteItem::RouteItem(const ip_addr& _ip, const ip_addr& _mask,
       metric(_metric) {
   ipPrefix.s_addr = _ip.s_addr & _mask.s_addr;
   nextHopMac = _mac;
+  setHop(_dev, _mac);
 }
 
 bool operator<(const RouteItem& rl, const RouteItem& rr) {
@@ -34,6 +37,58 @@ bool RouteItem::haveIp(const ip_addr& ip) const {
          (ipPrefix.s_addr & subNetMask.s_addr);
 }
 
+NextHop* RouteItem::findHop(const MAC::MacAddr& mac) const {
+  for (int i = 0; i < hopCnt; ++i)
+    if (nextHops[i].mac == mac) return &nextHops[i];
+  return nullptr;
+}
+
+void RouteItem::setHop(const Device::DevicePtr& _dev,
+                       const MAC::MacAddr& mac) const {
+  for (int i = 1; i < hopCnt; ++i) nextHops[i] = NextHop();
+  nextHops[0] = {_dev, mac, 0};
+  hopCnt = 1;
+  syncPrimary();
+}
+
+bool RouteItem::addHop(const Device::DevicePtr& _dev,
+                       const MAC::MacAddr& mac) const {
+  if (findHop(mac) || hopCnt == ROUTE_MAX_NEXTHOPS) return false;
+  nextHops[hopCnt++] = {_dev, mac, 0};
+  return true;
+}
+
+int RouteItem::delHop(const MAC::MacAddr& mac) const {
+  auto hop = findHop(mac);
+  if (!hop) return hopCnt;
+  // keep the order, the first hop is the primary one
+  std::move(hop + 1, nextHops.begin() + hopCnt, hop);
+  nextHops[--hopCnt] = NextHop();
+  syncPrimary();
+  return hopCnt;
+}
+
+const NextHop& RouteItem::pickHop(uint32_t flowHash) const {
+  int best = 0;
+  uint64_t bestScore = 0;
+  for (int i = 0; i < hopCnt; ++i) {
+    uint64_t k = 0;
+    memcpy(&k, nextHops[i].mac.addr, ETHER_ADDR_LEN);
+    uint64_t z = Flow::rendezvous(flowHash, k);
+    if (i == 0 || z > bestScore) {
+      best = i;
+      bestScore = z;
+    }
+  }
+  return nextHops[best];
+}
+
+void RouteItem::syncPrimary() const {
+  if (hopCnt == 0) return;
+  dev = nextHops[0].dev;
+  nextHopMac = nextHops[0].mac;
+}
+
 int maskToPflen(const in_addr& mask) {
   int pflen = 0;
   auto n = mask.s_addr;
@@ -60,58 +115,100 @@ namespace SDP {
 
 SDPManager sdpMgr;
 
+namespace {
+// send items in frames no longer than the MTU of the device, all frames but
+// the last one are marked unfinished
+void sendSplit(const SDPItemVector& sis, int flag,
+               const Device::DevicePtr& dev, const u_char* toMac) {
+  int per = std::min(MAX_SDP_DATA_LEN, (dev->getMtu() - SDPP_SIZE(0)) / 8);
+  for (size_t pos = 0; pos < sis.size(); pos += per) {
+    int size = std::min(sis.size() - pos, static_cast<size_t>(per));
+    bool last = pos + size == sis.size();
+    DEFINE_SDPPACKET(sdppSend, size);
+    sdppSend.flag = flag | (last ? 0 : SDPFLAG_UNFINISH);
+    sdppSend.len = size;
+
+    for (int cnt = 0; cnt < size; ++cnt) {
+      auto& i = sis[pos + cnt];
+      sdppSend.data[cnt].IpPrefix = i.ipPrefix;
+      sdppSend.data[cnt].pflen = Route::maskToPflen(i.subNetMask);
+      sdppSend.data[cnt].dist = i.dist + 1;
+      sdppSend.data[cnt].itemFlag |= (i.toDel ? SDP_ITEMFLAG_DEL : 0);
+    }
+
+    dev->getMAC(sdppSend.mac);
+    // Printer::printSDP(sdppSend, true);
+    Device::deviceMgr.sendFrame(&sdppSend, SDPP_SIZE(size), ETHERTYPE_SDP,
+                                toMac, dev);
+  }
+}
+}  // namespace
+
 void SDPManager::sendSDPPacketsTo(const SDPItemVector& sis, int flag,
                                   Device::DevicePtr withDev,
                                   MAC::MacAddr toMac) {
-  int size = sis.size();
-  if (size == 0) return;
-
-  ASSERT(size <= MAX_SDP_DATA_LEN, "Too large Routing table: %d", size);
-  DEFINE_SDPPACKET(sdppSend, size);
-  sdppSend.flag = flag;
-  sdppSend.len = size;
-
-  int cnt = 0;
-  for (auto& i : sis) {
-    sdppSend.data[cnt].IpPrefix = i.ipPrefix;
-    sdppSend.data[cnt].pflen = Route::maskToPflen(i.subNetMask);
-    sdppSend.data[cnt].dist = i.dist + 1;
-    sdppSend.data[cnt].itemFlag |= (i.toDel ? SDP_ITEMFLAG_DEL : 0);
-    cnt++;
-  }
-
-  withDev->getMAC(sdppSend.mac);
-  // Printer::printSDP(sdppSend, true);
-  Device::deviceMgr.sendFrame(&sdppSend, SDPP_SIZE(size), ETHERTYPE_SDP,
-                              toMac.addr, withDev);
+  if (sis.size() == 0) return;
+  sendSplit(sis, flag, withDev, toMac.addr);
 }
 
 void SDPManager::sendSDPPackets(const std::vector<SDPItem>& sis, int flag,
                                 Device::DevicePtr withoutDev) {
-  int size = sis.size();
-  if (size == 0) return;
-
-  ASSERT(size <= MAX_SDP_DATA_LEN, "Too large Routing table: %d", size);
-  DEFINE_SDPPACKET(sdppSend, size);
-  sdppSend.flag = flag;
-  sdppSend.len = size;
-
-  int cnt = 0;
-  for (auto& i : sis) {
-    sdppSend.data[cnt].IpPrefix = i.ipPrefix;
-    sdppSend.data[cnt].pflen = Route::maskToPflen(i.subNetMask);
-    sdppSend.data[cnt].dist = i.dist + 1;
-    sdppSend.data[cnt].itemFlag |= (i.toDel ? SDP_ITEMFLAG_DEL : 0);
-    cnt++;
+  if (sis.size() == 0) return;
+  for (auto& dev : Device::deviceMgr.devices) {
+    if (dev == withoutDev || dev->isSlave()) continue;
+    sendSplit(sis, flag, dev, Ether::broadcastMacAddr);
+  }
+}
+
+int SDPManager::reassemble(DeviceId id, const MAC::MacAddr& mac, int flag,
+                           SDPItemVector& sis) {
+  std::lock_guard<std::mutex> lck(pending_m);
+  auto now = Clock::now();
+  // forget advertisements whose last frame never came
+  for (auto iter = pending.begin(); iter != pending.end();) {
+    if (iter->second.expire <= now)
+      iter = pending.erase(iter);
+    else
+      ++iter;
   }
 
-  for (auto& dev : Device::deviceMgr.devices) {
-    if (dev == withoutDev) continue;
-    dev->getMAC(sdppSend.mac);
-    // Printer::printSDP(sdppSend, true);
-    Device::deviceMgr.sendFrame(&sdppSend, SDPP_SIZE(size), ETHERTYPE_SDP,
-                                Ether::broadcastMacAddr, dev);
+  uint64_t key = static_cast<uint64_t>(id) << 48;
+  for (int i = 0; i < ETHER_ADDR_LEN; ++i)
+    key |= static_cast<uint64_t>(mac.addr[i]) << (8 * i);
+
+  if (flag & SDPFLAG_UNFINISH) {
+    auto iter = pending.find(key);
+    if (iter == pending.end()) {
+      if (pending.size() >= SDP_REASSEMBLY_MAX_PENDING) {
+        LOG_WARN("Too many SDP advertisements being collected, drop frame.");
+        return 0;
+      }
+      // counted from the first frame, later frames do not keep it alive
+      iter = pending.emplace(key, Pending()).first;
+      iter->second.expire = now + std::chrono::seconds(SDP_REASSEMBLY_TIMEOUT);
+    }
+    auto& p = iter->second;
+    if (!p.dropped && p.sis.size() + sis.size() > SDP_REASSEMBLY_MAX_ITEMS) {
+      LOG_WARN("SDP advertisement is too large, drop it.");
+      p.dropped = true;
+      SDPItemVector().swap(p.sis);
+    }
+    if (!p.dropped) p.sis.insert(p.sis.end(), sis.begin(), sis.end());
+    return 0;
+  }
+
+  auto iter = pending.find(key);
+  if (iter != pending.end()) {
+    if (iter->second.dropped) {
+      pending.erase(iter);
+      return 0;
+    }
+    auto& all = iter->second.sis;
+    all.insert(all.end(), sis.begin(), sis.end());
+    sis = std::move(all);
+    pending.erase(iter);
   }
+  return 1;
 }
 }  // namespace SDP
 
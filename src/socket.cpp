@@ -148,14 +148,22 @@ ssize_t Socket::read(u_char* buf, size_t nbyte) {
 }
 
 ssize_t Socket::write(const u_char* buf, size_t nbyte) {
-  Tcp::TcpSegment ts(src.port, dst.port);
-  ts.setFlags(TH_PUSH + TH_ACK);
-  ts.setPayload(buf, nbyte);
-  ts.setSeq(tcpWorker.seq, nbyte);
-  ts.setAck(tcpWorker.seq.rcv_nxt);
-  Tcp::TcpItem ti(ts, src.ip, dst.ip);
+  // split into segments fitting in the path MTU
+  size_t mss = Tcp::getMss(src.ip, dst.ip), sent = 0;
+  do {
+    size_t len = std::min(nbyte - sent, mss);
+    Tcp::TcpSegment ts(src.port, dst.port);
+    ts.setFlags(len == nbyte - sent ? TH_PUSH + TH_ACK : TH_ACK);
+    ts.setPayload(buf + sent, len);
+    ts.setSeq(tcpWorker.seq, len);
+    ts.setAck(tcpWorker.seq.rcv_nxt);
+    Tcp::TcpItem ti(ts, src.ip, dst.ip);
 
-  return tcpWorker.send(ti);
+    auto res = tcpWorker.send(ti);
+    if (res < 0) return sent ? sent : res;
+    sent += res;
+  } while (sent < nbyte);
+  return sent;
 }
 
 ssize_t Socket::send(Tcp::TcpItem& ti) { return tcpWorker.send(ti); }
@@ -278,6 +286,10 @@ SocketPtr SocketManager::getListeningSocket(const SocketAddr src) {
 int SocketManager::socket(int domain, int type, int protocol) {
   if (nextFd == -1) RET_SETERRNO(ENFILE);
   if (domain != AF_INET) RET_SETERRNO(EAFNOSUPPORT);
+  if (type == SOCK_DGRAM) {
+    if (protocol != 0 && protocol != IPPROTO_UDP) RET_SETERRNO(EPROTONOSUPPORT);
+    return Udp::udpMgr.socket(nextFd++);
+  }
   if (type != SOCK_STREAM) RET_SETERRNO(EPROTOTYPE);
   if (protocol != IPPROTO_TCP) RET_SETERRNO(EPROTONOSUPPORT);
   auto sock = std::make_shared<Socket>(domain, type, protocol, nextFd++);
@@ -294,12 +306,15 @@ int SocketManager::bind(int socket, const struct sockaddr* address,
   if (addr_in->sin_len != INET_ADDRSTRLEN) RET_SETERRNO(EINVAL);
 #endif
   // if (getSocket(address)) RET_SETERRNO(EADDRINUSE);
+  if (auto u = Udp::udpMgr.getSocket(socket))
+    return Udp::udpMgr.bind(u, SocketAddr(address));
   SocketPtr s = getSocket(socket);
   if (!s) RET_SETERRNO(EBADF);
   return s->bind(address, address_len);
 }
 
 int SocketManager::listen(int socket, int backlog) {
+  if (Udp::udpMgr.getSocket(socket)) RET_SETERRNO(EOPNOTSUPP);
   SocketPtr s = getSocket(socket);
   if (!s) RET_SETERRNO(EBADF);
   return s->listen(backlog);
@@ -307,6 +322,7 @@ int SocketManager::listen(int socket, int backlog) {
 
 int SocketManager::accept(int socket, sockaddr* address,
                           socklen_t* address_len) {
+  if (Udp::udpMgr.getSocket(socket)) RET_SETERRNO(EOPNOTSUPP);
   SocketPtr s = getSocket(socket);
   if (!s) RET_SETERRNO(EBADF);
   return s->accept(address, address_len);
@@ -314,23 +330,62 @@ int SocketManager::accept(int socket, sockaddr* address,
 
 int SocketManager::connect(int socket, const sockaddr* address,
                            socklen_t address_len) {
+  if (auto u = Udp::udpMgr.getSocket(socket))
+    return u->connect(SocketAddr(address));
   SocketPtr s = getSocket(socket);
   if (!s) RET_SETERRNO(EBADF);
   return s->connect(address, address_len);
 }
 
 ssize_t SocketManager::read(int fildes, u_char* buf, size_t nbyte) {
+  if (auto u = Udp::udpMgr.getSocket(fildes))
+    return u->recvfrom(buf, nbyte, nullptr);
   SocketPtr s = getSocket(fildes);
   if (!s) RET_SETERRNO(EBADF);
   return s->read(buf, nbyte);
 }
 ssize_t SocketManager::write(int fildes, const u_char* buf, size_t nbyte) {
+  if (auto u = Udp::udpMgr.getSocket(fildes)) {
+    if (u->dst.isZero()) RET_SETERRNO(EDESTADDRREQ);
+    sockaddr_in addr;
+    u->dst.get(reinterpret_cast<sockaddr*>(&addr));
+    return sendto(fildes, buf, nbyte, 0, reinterpret_cast<sockaddr*>(&addr),
+                  sizeof(addr));
+  }
   SocketPtr s = getSocket(fildes);
   if (!s) RET_SETERRNO(EBADF);
   return s->write(buf, nbyte);
 }
 
+ssize_t SocketManager::sendto(int socket, const u_char* buf, size_t nbyte,
+                              int flags, const sockaddr* dest_addr,
+                              socklen_t dest_len) {
+  auto u = Udp::udpMgr.getSocket(socket);
+  if (!u) RET_SETERRNO(getSocket(socket) ? EOPNOTSUPP : EBADF);
+  if (!dest_addr) RET_SETERRNO(EDESTADDRREQ);
+  if (dest_len < sizeof(sockaddr_in)) RET_SETERRNO(EINVAL);
+  if (dest_addr->sa_family != AF_INET) RET_SETERRNO(EAFNOSUPPORT);
+  // bind to a port if not bound
+  if (u->src.port == 0 && Udp::udpMgr.bind(u, SocketAddr()) < 0) return -1;
+  return u->sendto(buf, nbyte, SocketAddr(dest_addr));
+}
+
+ssize_t SocketManager::recvfrom(int socket, u_char* buf, size_t nbyte,
+                                int flags, sockaddr* address,
+                                socklen_t* address_len) {
+  auto u = Udp::udpMgr.getSocket(socket);
+  if (!u) RET_SETERRNO(getSocket(socket) ? EOPNOTSUPP : EBADF);
+  SocketAddr from;
+  auto res = u->recvfrom(buf, nbyte, &from, !(flags & MSG_DONTWAIT));
+  if (res >= 0 && address) {
+    from.get(address);
+    *address_len = INET_ADDRSTRLEN;
+  }
+  return res;
+}
+
 int SocketManager::close(int fildes) {
+  if (Udp::udpMgr.getSocket(fildes)) return Udp::udpMgr.close(fildes);
   SocketPtr s = getSocket(fildes);
   if (!s) RET_SETERRNO(EBADF);
   return s->close();
@@ -339,21 +394,25 @@ int SocketManager::close(int fildes) {
 SocketManager sockmgr;
 
 int tcpDispatcher(const void* buf, int len) {
-  Ip::IpPacket ipp((u_char*)buf, len);
+  Ip::IpView ipv(buf, len);
+  if (!ipv.valid()) return 0;
   SocketAddr srcSaddr, dstSaddr;
-  srcSaddr.ip = ipp.hdr.ip_src;
-  dstSaddr.ip = ipp.hdr.ip_dst;
-  Tcp::TcpSegment ts((u_char*)ipp.data, len - ipp.hdr.ip_hl * 4);
-  Tcp::TcpItem ti(ts, ipp.hdr.ip_src, ipp.hdr.ip_dst);
-  ti.setChecksum();
-  ti.ntoh();
-  srcSaddr.port = ti.ts.hdr.th_sport;
-  dstSaddr.port = ti.ts.hdr.th_dport;
-  // Printer::printIpPacket(ipp);
-  Printer::printTcpItem(ti);
+  srcSaddr.ip = ipv.getSrc();
+  dstSaddr.ip = ipv.getDst();
+  Tcp::TcpView tv(ipv.getPayload(), ipv.getPayloadLength(), srcSaddr.ip,
+                  dstSaddr.ip);
+  if (!tv.valid()) {
+    LOG_WARN("Bad TCP segment.");
+    return 0;
+  }
+  if (!tv.chkChksum()) LOG_WARN("Checksum error.");
+  srcSaddr.port = tv.hdr.th_sport;
+  dstSaddr.port = tv.hdr.th_dport;
+  // Printer::printIpPacket(ipv);
+  Printer::printTcpView(tv);
 
   SocketPtr sock;
-  if (Tcp::ISTYPE_SYN(ts.hdr)) {
+  if (Tcp::ISTYPE_SYN(tv.hdr)) {
     sock = sockmgr.getListeningSocket(dstSaddr);
   } else {
     sock = sockmgr.getSocket(dstSaddr, srcSaddr);
@@ -362,7 +421,7 @@ int tcpDispatcher(const void* buf, int len) {
     LOG_WARN("A segment cannot match any local socket.");
     return 0;
   }
-  sock->tcpWorker.handler(ti);
+  sock->tcpWorker.handler(tv);
   return 0;
 }
 }  // namespace Socket
@@ -134,7 +134,8 @@ void TcpWorker::senderLoop() {
       ti.ntoh();
       ti.setChecksum();
     }
-    Ip::sendIPPacket(ti.srcIp, ti.dstIp, IPPROTO_TCP, &ti.ts, ti.ts.totalLen);
+    iovec seg = {&ti.ts, static_cast<size_t>(ti.ts.totalLen)};
+    Ip::sendIPPacket(dstCache, ti.srcIp, ti.dstIp, IPPROTO_TCP, &seg, 1);
 
     if (ti.nonblock) {
       // send next segment if nonblock
@@ -190,7 +191,9 @@ void TcpWorker::senderNonBlockLoop() {
     Printer::printTcpItem(ti, true, "(NonBlock)");
     ti.ntoh();
     ti.setChecksum();
-    Ip::sendIPPacket(ti.srcIp, ti.dstIp, IPPROTO_TCP, &ti.ts, ti.ts.totalLen);
+    iovec seg = {&ti.ts, static_cast<size_t>(ti.ts.totalLen)};
+    Ip::sendIPPacket(dstCacheNonBlock, ti.srcIp, ti.dstIp, IPPROTO_TCP, &seg,
+                     1);
   }
 }  // namespace Tcp
 
@@ -221,8 +224,8 @@ ssize_t TcpWorker::read(u_char* buf, size_t nby) {
   return nby;
 }
 
-void TcpWorker::handler(TcpItem& recvti) {
-  auto hdr = recvti.ts.hdr;
+void TcpWorker::handler(const TcpView& recvti) {
+  auto hdr = recvti.hdr;
   std::unique_lock stlck(stSameCv_m);
   stSameCv.wait(stlck, [&] { return (st.load() == criticalSt.load()); });
   setCriticalSt(TcpState::INVAL);
@@ -251,7 +254,7 @@ void TcpWorker::handler(TcpItem& recvti) {
   if (syned.load() && hdr.th_seq < seq.rcv_nxt) {
     LOG_INFO("Send a duplicated ACK");
     auto ti = buildAckItem(srcSaddr, dstSaddr, seq, seq_m, {},
-                           hdr.th_seq + recvti.ts.dataLen);
+                           hdr.th_seq + recvti.dataLen);
     this->send(ti);
     setCriticalSt(getSt());
     return;
@@ -274,7 +277,7 @@ void TcpWorker::handler(TcpItem& recvti) {
       // LISTEN --[rcv SYN, snd SYN/ACK]--> SYN_RCVD > `accept`
       if (ISTYPE_SYN(hdr)) {
         if (backlog == 0 || static_cast<int>(pendings.size()) < backlog) {
-          tcp_seq seq = recvti.ts.hdr.th_seq;
+          tcp_seq seq = recvti.hdr.th_seq;
           pendings.push(std::make_pair(dstSaddr, seq));
           acceptCv.notify_all();
         }
@@ -346,10 +349,10 @@ void TcpWorker::handler(TcpItem& recvti) {
         }
       }
       {  // get save and update rcv_nxt
-        int len = recvti.ts.dataLen;
+        int len = recvti.dataLen;
         if (len > 0) {
           bool pshflag = WITHTYPE_PUSH(hdr);
-          recvBuf.write(recvti.ts.data, len, pshflag);
+          recvBuf.write(recvti.data, len, pshflag);
           recvCv.notify_all();
           if (!WITHTYPE_FIN(hdr)) {
             auto ti = buildAckItem(srcSaddr, dstSaddr, seq, seq_m, len);
@@ -369,10 +372,10 @@ void TcpWorker::handler(TcpItem& recvti) {
     }
     case TcpState::FIN_WAIT_1: {
       {  // save data and update rcv_nxt
-        int len = recvti.ts.dataLen;
+        int len = recvti.dataLen;
         if (len > 0) {
           bool pshflag = WITHTYPE_PUSH(hdr);
-          recvBuf.write(recvti.ts.data, len, pshflag);
+          recvBuf.write(recvti.data, len, pshflag);
           recvCv.notify_all();
           if (!WITHTYPE_FIN(hdr)) {
             auto ti = buildAckItem(srcSaddr, dstSaddr, seq, seq_m, len);
@@ -431,10 +434,10 @@ void TcpWorker::handler(TcpItem& recvti) {
         }
       }  // end handle ACK
       {  // save data and update rcv_nxt
-        int len = recvti.ts.dataLen;
+        int len = recvti.dataLen;
         if (len > 0) {
           bool pshflag = WITHTYPE_PUSH(hdr);
-          recvBuf.write(recvti.ts.data, len, pshflag);
+          recvBuf.write(recvti.data, len, pshflag);
           recvCv.notify_all();
           if (!WITHTYPE_FIN(hdr)) {
             auto ti = buildAckItem(srcSaddr, dstSaddr, seq, seq_m, len);
@@ -108,6 +108,44 @@ void TcpSegment::ntoh() {
   hdr.th_sum = 0;
 }
 
+TcpView::TcpView(const void* buf, int len, ip_addr src, ip_addr dst)
+    : seg(reinterpret_cast<const u_char*>(buf)),
+      totalLen(len),
+      srcIp(src),
+      dstIp(dst) {
+  if (len < static_cast<int>(sizeof(tcphdr))) {
+    memset(&hdr, 0, sizeof(tcphdr));
+    data = seg;
+    dataLen = -1;
+    return;
+  }
+  memcpy(&hdr, seg, sizeof(tcphdr));
+  hdr.th_sport = ntohs(hdr.th_sport);
+  hdr.th_dport = ntohs(hdr.th_dport);
+  hdr.th_seq = ntohl(hdr.th_seq);
+  hdr.th_ack = ntohl(hdr.th_ack);
+  hdr.th_win = ntohs(hdr.th_win);
+  hdr.th_urp = ntohs(hdr.th_urp);
+
+  int off = hdr.th_off * 4;
+  data = seg + off;
+  dataLen = (off < static_cast<int>(sizeof(tcphdr)) || off > len) ? -1
+                                                                  : len - off;
+}
+
+bool TcpView::chkChksum() const {
+  struct __attribute__((__packed__)) {
+    ip_addr src;
+    ip_addr dst;
+    uint8_t zeros;
+    uint8_t proto;
+    uint16_t tcp_len;
+  } psd = {srcIp, dstIp, 0, IPPROTO_TCP, htons(totalLen)};
+  auto sum = Ip::combineChecksum(Ip::getChecksum(&psd, sizeof(psd)),
+                                 Ip::getChecksum(seg, totalLen));
+  return sum == 0;
+}
+
 void TcpItem::hton() { ts.hton(); }
 void TcpItem::ntoh() { ts.ntoh(); }
 void TcpItem::setChecksum() {
@@ -136,6 +174,12 @@ TcpItem buildAckItem(Socket::SocketAddr src, Socket::SocketAddr dst,
   return ti;
 }
 
+int getMss(const ip_addr& src, const ip_addr& dst) {
+  auto dev = Device::deviceMgr.getDevicePtr(src);
+  int mtu = dev ? dev->getMtu() : ETHERMTU;
+  return Pmtu::pmtuCache.get(dst, mtu) - sizeof(ip) - sizeof(tcphdr);
+}
+
 #define X(TCPNAME, TCPFLAG) \
   bool ISTYPE_##TCPNAME(tcphdr t) { return (t.th_flags) == TCPFLAG; }
 TCP_TYPE_MAP
@@ -161,4 +205,14 @@ void printTcpItem(const Tcp::TcpItem& ti, bool sender, std::string info) {
   printf("   [ seq=%u, ack=%u ], len=%d(%d)\n", ti.ts.hdr.th_seq,
          ti.ts.hdr.th_ack, ti.ts.dataLen, ti.ts.totalLen);
 }
+
+void printTcpView(const Tcp::TcpView& tv) {
+  Socket::SocketAddr srcSaddr(tv.srcIp, tv.hdr.th_sport);
+  Socket::SocketAddr dstSaddr(tv.dstIp, tv.hdr.th_dport);
+  printf(">> \033[;1mTCP\033[0m %s -> %s, f=0x%02x %s\t \n",
+         srcSaddr.toStr().c_str(), dstSaddr.toStr().c_str(), tv.hdr.th_flags,
+         Tcp::tcpFlagStr(tv.hdr.th_flags).c_str());
+  printf("   [ seq=%u, ack=%u ], len=%d(%d)\n", tv.hdr.th_seq, tv.hdr.th_ack,
+         tv.dataLen, tv.totalLen);
+}
 }  // namespace Printer
\ No newline at end of file
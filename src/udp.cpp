@@ -0,0 +1,203 @@
+#include "udp.h"
+
+#include "tcp.h"
+
+namespace {
+// checksum of the pseudo header and the UDP header, data not included
+uint16_t headerChecksum(const ip_addr& src, const ip_addr& dst,
+                        const void* hdr) {
+  u_char buf[12 + sizeof(udphdr)];
+  uint16_t len;
+  memcpy(&len, reinterpret_cast<const u_char*>(hdr) + 4, sizeof(uint16_t));
+  memcpy(buf, &src, 4);
+  memcpy(buf + 4, &dst, 4);
+  buf[8] = 0;
+  buf[9] = IPPROTO_UDP;
+  memcpy(buf + 10, &len, sizeof(uint16_t));
+  memcpy(buf + 12, hdr, sizeof(udphdr));
+  return Ip::getChecksum(buf, sizeof(buf));
+}
+}  // namespace
+
+namespace Udp {
+
+UdpManager udpMgr;
+
+UdpSocket::UdpSocket(int fd)
+    : fd(fd), bytes(std::make_unique<u_char[]>(UDP_RECV_BYTES)) {}
+
+int UdpSocket::bind(const Socket::SocketAddr& addr) {
+  std::lock_guard<std::mutex> lck(m);
+  if (src.port != 0) RET_SETERRNO(EINVAL);
+  src = addr;
+  return 0;
+}
+
+int UdpSocket::connect(const Socket::SocketAddr& addr) {
+  std::lock_guard<std::mutex> lck(m);
+  dst = addr;
+  return 0;
+}
+
+ssize_t UdpSocket::sendto(const u_char* buf, size_t nbyte,
+                          const Socket::SocketAddr& to) {
+  if (nbyte > IP_MAXPACKET - sizeof(ip) - sizeof(udphdr))
+    RET_SETERRNO(EMSGSIZE);
+
+  // choose the device by route if not bound to an address
+  ip_addr srcIp = src.ip;
+  if (srcIp.s_addr == 0) {
+    auto ri = Route::router.lookup(to.ip);
+    if (ri.ipPrefix.s_addr == 0) RET_SETERRNO(ENETUNREACH);
+    srcIp = ri.dev->getIp();
+  }
+
+  udphdr hdr;
+  hdr.uh_sport = htons(src.port);
+  hdr.uh_dport = htons(to.port);
+  hdr.uh_ulen = htons(sizeof(udphdr) + nbyte);
+  hdr.uh_sum = 0;
+  uint16_t sum = Ip::combineChecksum(headerChecksum(srcIp, to.ip, &hdr),
+                                     Ip::getChecksum(buf, nbyte));
+  // zero means no checksum (RFC 768)
+  hdr.uh_sum = sum == 0 ? 0xffff : sum;
+
+  iovec parts[2] = {{&hdr, sizeof(udphdr)},
+                    {const_cast<u_char*>(buf), nbyte}};
+  if (Ip::sendIPPacket(srcIp, to.ip, IPPROTO_UDP, parts, 2) < 0)
+    RET_SETERRNO(EIO);
+  return nbyte;
+}
+
+ssize_t UdpSocket::recvfrom(u_char* buf, size_t nbyte,
+                            Socket::SocketAddr* from, bool block) {
+  std::unique_lock<std::mutex> lck(m);
+  if (head == tail) {
+    if (!block) RET_SETERRNO(EAGAIN);
+    cv.wait(lck, [&] { return head != tail || closed; });
+    if (head == tail) RET_SETERRNO(EBADF);
+  }
+
+  auto& d = descs[head % UDP_RECV_QUEUE];
+  size_t n = std::min(nbyte, static_cast<size_t>(d.len));
+  memcpy(buf, &bytes[d.off % UDP_RECV_BYTES], n);
+  if (from) *from = d.src;
+  byteHead = d.off + d.len;
+  ++head;
+  return n;
+}
+
+int UdpSocket::push(const Socket::SocketAddr& from, const u_char* data,
+                    int len) {
+  std::unique_lock<std::mutex> lck(m);
+  if (closed || tail - head == UDP_RECV_QUEUE) return -1;
+
+  // a datagram is stored contiguously: skip the end of the ring if it does
+  // not fit there
+  size_t off = byteTail, pos = off % UDP_RECV_BYTES;
+  if (pos + len > UDP_RECV_BYTES) off += UDP_RECV_BYTES - pos;
+  if (off + len - byteHead > UDP_RECV_BYTES) return -1;
+
+  memcpy(&bytes[off % UDP_RECV_BYTES], data, len);
+  descs[tail % UDP_RECV_QUEUE] = {from, off, len};
+  byteTail = off + len;
+  ++tail;
+  lck.unlock();
+  cv.notify_one();
+  return 0;
+}
+
+int UdpSocket::close() {
+  std::unique_lock<std::mutex> lck(m);
+  closed = true;
+  lck.unlock();
+  cv.notify_all();
+  return 0;
+}
+
+//================= UdpManager =================//
+
+int UdpManager::socket(int fd) {
+  std::unique_lock<std::shared_mutex> lck(m);
+  sockets[fd] = std::make_shared<UdpSocket>(fd);
+  return fd;
+}
+
+UdpSocketPtr UdpManager::getSocket(int fd) {
+  std::shared_lock<std::shared_mutex> lck(m);
+  auto iter = sockets.find(fd);
+  return iter == sockets.end() ? nullptr : iter->second;
+}
+
+UdpSocketPtr UdpManager::getSocket(const Socket::SocketAddr& addr) {
+  std::shared_lock<std::shared_mutex> lck(m);
+  auto iter = ports.find(addr.port);
+  if (iter == ports.end()) return nullptr;
+  auto& ip = iter->second->src.ip;
+  if (ip.s_addr != 0 && !(ip == addr.ip)) return nullptr;
+  return iter->second;
+}
+
+int UdpManager::bind(const UdpSocketPtr& sock, Socket::SocketAddr addr) {
+  std::unique_lock<std::shared_mutex> lck(m);
+  if (addr.port == 0) {
+    for (int i = 0; ports.count(nextPort) && i < 65536 - UDP_EPHEMERAL_PORT;
+         ++i)
+      nextPort = nextPort == 65535 ? UDP_EPHEMERAL_PORT : nextPort + 1;
+    if (ports.count(nextPort)) RET_SETERRNO(EADDRINUSE);
+    addr.port = nextPort;
+  }
+  if (ports.count(addr.port)) RET_SETERRNO(EADDRINUSE);
+  if (sock->bind(addr) < 0) return -1;
+  ports[addr.port] = sock;
+  return 0;
+}
+
+int UdpManager::close(int fd) {
+  std::unique_lock<std::shared_mutex> lck(m);
+  auto iter = sockets.find(fd);
+  if (iter == sockets.end()) RET_SETERRNO(EBADF);
+  auto sock = iter->second;
+  sockets.erase(iter);
+  auto p = ports.find(sock->src.port);
+  if (p != ports.end() && p->second == sock) ports.erase(p);
+  lck.unlock();
+  return sock->close();
+}
+
+int udpCallBack(const void* buf, int len) {
+  Ip::IpView ipv(buf, len);
+  const u_char* seg = ipv.getPayload();
+  int segLen = ipv.getPayloadLength();
+  if (segLen < static_cast<int>(sizeof(udphdr))) {
+    LOG_WARN("Bad UDP datagram.");
+    return 0;
+  }
+  udphdr hdr;
+  memcpy(&hdr, seg, sizeof(udphdr));
+  int ulen = ntohs(hdr.uh_ulen);
+  if (ulen < static_cast<int>(sizeof(udphdr)) || ulen > segLen) {
+    LOG_WARN("Bad UDP datagram.");
+    return 0;
+  }
+  if (hdr.uh_sum != 0) {
+    uint16_t sum = headerChecksum(ipv.getSrc(), ipv.getDst(), seg);
+    sum = Ip::combineChecksum(sum, Ip::getChecksum(seg + sizeof(udphdr),
+                                                   ulen - sizeof(udphdr)));
+    if (sum != 0) {
+      LOG_WARN("UDP checksum error.");
+      return 0;
+    }
+  }
+
+  Socket::SocketAddr srcSaddr(ipv.getSrc(), ntohs(hdr.uh_sport));
+  Socket::SocketAddr dstSaddr(ipv.getDst(), ntohs(hdr.uh_dport));
+  auto sock = udpMgr.getSocket(dstSaddr);
+  // no socket bound: to the raw IP callback, as before UDP sockets
+  if (!sock) return Ip::callback ? Ip::callback(buf, len) : 0;
+  if (sock->push(srcSaddr, seg + sizeof(udphdr), ulen - sizeof(udphdr)) < 0)
+    LOG_WARN("UDP receive queue is full, drop datagram.");
+  return 0;
+}
+
+}  // namespace Udp
@@ -37,9 +37,9 @@ int main(int argc, char* argv[]) {
     LOG_ERR("Ip address error: %s", argv[2]);
     return 0;
   }
-  Arp::arpMgr.getMacAddr(dev, ip, 5);
+  auto mac = Arp::arpMgr.getMacAddr(dev, ip, 5);
   printf("MAC address: ");
-  Printer::printMAC(Arp::arpMgr.ipMacMap[ip].addr);
+  Printer::printMAC(mac.addr);
   Printer::printArpTable();
 
   Device::deviceMgr.keepReceiving();
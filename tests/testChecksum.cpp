@@ -4,10 +4,15 @@
  * @version 0.1
  * @date 2019-11-22
  *
- * @brief Test: checksum function
+ * @brief Test: checksum function, and all checksum kernels are compared with
+ * the scalar one and benchmarked.
  *
  */
 
+#include <chrono>
+#include <cstdlib>
+
+#include "checksum.h"
 #include "ip.h"
 
 uint16_t checksum(uint16_t *addr, int len) {
@@ -47,6 +52,62 @@ uint16_t checksum(uint16_t *addr, int len) {
 
 int caseNum = 1;
 
+const Checksum::Kernel kernels[] = {
+#define X(KERNELNAME) Checksum::Kernel::KERNELNAME,
+    CHECKSUM_KERNEL_SET
+#undef X
+};
+
+u_char buffer[IP_MAXPACKET + 64];
+
+void checkKernels() {
+  int bad = 0;
+  for (size_t len = 0; len <= IP_MAXPACKET; len += (len < 600 ? 1 : 997)) {
+    for (int align = 0; align < 64; ++align) {
+      auto expected =
+          Checksum::getChecksum(Checksum::Kernel::SCALAR, buffer + align, len);
+      for (auto k : kernels) {
+        if (!Checksum::isSupported(k)) continue;
+        if (Checksum::getChecksum(k, buffer + align, len) != expected) {
+          if (bad++ < 8)
+            LOG_ERR("Kernel %s mismatched. length: %zu, align: %d",
+                    Checksum::kernelToStr(k).c_str(), len, align);
+        }
+      }
+    }
+  }
+  if (bad)
+    LOG_ERR("case %d [ KERNELS ] %d mismatches.", caseNum++, bad)
+  else
+    LOG_INFO("case %d [ KERNELS ] All kernels agree.", caseNum++);
+}
+
+void benchmark() {
+  const size_t sizes[] = {20, 64, 256, 1500, 9000, IP_MAXPACKET};
+  volatile uint16_t sink = 0;
+
+  printf("%-8s %8s %6s %12s %12s\n", "kernel", "size", "align", "ns/call",
+         "MB/s");
+  for (auto k : kernels) {
+    if (!Checksum::isSupported(k)) continue;
+    for (auto len : sizes) {
+      for (int align = 0; align < 4; ++align) {
+        size_t rounds = (1 << 23) / len + 1;
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < rounds; ++i)
+          sink = sink + Checksum::getChecksum(k, buffer + align, len);
+        auto end = std::chrono::steady_clock::now();
+
+        double ns = std::chrono::duration<double, std::nano>(end - start)
+                        .count() / rounds;
+        printf("%-8s %8zu %6d %12.1f %12.1f\n",
+               Checksum::kernelToStr(k).c_str(), len, align, ns,
+               len / ns * 1e3);
+      }
+    }
+  }
+}
+
 int main() {
   CHECK(IPHDR1, {
                     0x45, 0x20, 0x00, 0x28, 0x56, 0x78, 0x40, 0x00, 0x33, 0x06,
@@ -72,5 +133,12 @@ int main() {
                     0x00, 0x00, 0x00, 0x00, /* option 4 */
                     0x01, 0x03, 0x03, 0x07, /* option 5 */
                 });
+
+  srand(0);
+  for (auto& b : buffer) b = rand();
+  checkKernels();
+  LOG_INFO("Selected kernel: %s",
+           Checksum::kernelToStr(Checksum::getKernel()).c_str());
+  benchmark();
   return 0;
 }
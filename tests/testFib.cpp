@@ -0,0 +1,178 @@
+/**
+ * @file testFib.cpp
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-07
+ *
+ * @brief Test: DIR-24-8 FIB with 100k prefixes. Lookups are compared with a
+ * reference matching prefixes of every length, after adding and after
+ * deleting, then benchmarked against a linear scan of the table.
+ *
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "fib.h"
+#include "type.h"
+
+#define PREFIXES 100000
+#define LOOKUPS (1 << 22)
+
+int caseNum = 1;
+
+struct Prefix {
+  uint32_t prefix;
+  int depth;
+  uint32_t nh;
+};
+
+uint32_t depthMask(int depth) { return depth ? ~0u << (32 - depth) : 0; }
+
+// the reference: look for a prefix of every length, the longest first
+std::unordered_map<uint32_t, uint32_t> rules[33];
+
+uint32_t refLookup(uint32_t ip) {
+  for (int d = 32; d >= 0; --d) {
+    auto iter = rules[d].find(ip & depthMask(d));
+    if (iter != rules[d].end()) return iter->second;
+  }
+  return FIB_NONE;
+}
+
+// lengths like a routing table: mostly /24, then /16 to /23, a few longer
+int randomDepth(std::mt19937& rng) {
+  int r = rng() % 100;
+  if (r < 55) return 24;
+  if (r < 90) return 16 + rng() % 8;
+  if (r < 97) return 25 + rng() % 8;
+  return 8 + rng() % 8;
+}
+
+void check(Fib::Fib& fib, const std::vector<uint32_t>& addrs,
+           const char* title) {
+  int bad = 0;
+  for (auto ip : addrs) {
+    if (fib.lookup(ip) != refLookup(ip)) {
+      if (bad++ < 8)
+        LOG_ERR("Mismatched: %08x, fib: %u, reference: %u", ip, fib.lookup(ip),
+                refLookup(ip));
+    }
+  }
+  if (bad)
+    LOG_ERR("case %d [ %s ] %d mismatches.", caseNum++, title, bad)
+  else
+    LOG_INFO("case %d [ %s ] All lookups agree.", caseNum++, title);
+}
+
+// addresses in and around the prefixes, and some random ones
+std::vector<uint32_t> makeAddrs(const std::vector<Prefix>& prefixes,
+                                std::mt19937& rng) {
+  std::vector<uint32_t> addrs;
+  for (auto& p : prefixes) {
+    uint32_t size = ~depthMask(p.depth);
+    addrs.push_back(p.prefix);
+    addrs.push_back(p.prefix | (rng() & size));
+    addrs.push_back(p.prefix | size);
+    addrs.push_back((p.prefix | size) + 1);
+    addrs.push_back(p.prefix - 1);
+  }
+  for (int i = 0; i < PREFIXES; ++i) addrs.push_back(rng());
+  return addrs;
+}
+
+double nsPerLookup(Fib::Fib& fib, const std::vector<uint32_t>& addrs) {
+  volatile uint32_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < LOOKUPS; ++i)
+    sink = sink + fib.lookup(addrs[i % addrs.size()]);
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         LOOKUPS;
+}
+
+// the routing table before the FIB: scan prefixes from the longest
+double nsPerScan(const std::vector<Prefix>& prefixes,
+                 const std::vector<uint32_t>& addrs) {
+  std::vector<Prefix> table(prefixes);
+  std::sort(table.begin(), table.end(),
+            [](const Prefix& a, const Prefix& b) { return a.depth > b.depth; });
+  const int rounds = 1000;
+  volatile uint32_t sink = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; ++i) {
+    uint32_t ip = addrs[i * 7919 % addrs.size()];
+    for (auto& p : table) {
+      if ((ip & depthMask(p.depth)) == p.prefix) {
+        sink = sink + p.nh;
+        break;
+      }
+    }
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+         rounds;
+}
+
+int main() {
+  std::mt19937 rng(0);
+  std::vector<Prefix> prefixes;
+  while (prefixes.size() < PREFIXES) {
+    int depth = randomDepth(rng);
+    uint32_t prefix = rng() & depthMask(depth);
+    if (rules[depth].count(prefix)) continue;
+    uint32_t nh = prefixes.size();
+    rules[depth][prefix] = nh;
+    prefixes.push_back({prefix, depth, nh});
+  }
+
+  Fib::Fib fib;
+  auto start = std::chrono::steady_clock::now();
+  for (auto& p : prefixes) {
+    if (fib.add(p.prefix, p.depth, p.nh) < 0)
+      LOG_ERR("Failed to add %08x/%d", p.prefix, p.depth);
+  }
+  auto end = std::chrono::steady_clock::now();
+  LOG_INFO("Added %zu prefixes in %.1f ms, %d groups of tbl8 used.",
+           fib.size(),
+           std::chrono::duration<double, std::milli>(end - start).count(),
+           fib.groupsUsed());
+
+  auto addrs = makeAddrs(prefixes, rng);
+  check(fib, addrs, "ADD");
+
+  // delete half of them, addresses go to covering prefixes
+  std::shuffle(prefixes.begin(), prefixes.end(), rng);
+  start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < prefixes.size() / 2; ++i) {
+    auto& p = prefixes[i];
+    fib.del(p.prefix, p.depth);
+    rules[p.depth].erase(p.prefix);
+  }
+  // nobody else reads it, groups unlinked are free at once
+  fib.reclaim();
+  end = std::chrono::steady_clock::now();
+  LOG_INFO("Deleted %zu prefixes in %.1f ms, %d groups of tbl8 used.",
+           prefixes.size() / 2,
+           std::chrono::duration<double, std::milli>(end - start).count(),
+           fib.groupsUsed());
+  check(fib, addrs, "DELETE");
+
+  // and add them back with other next hops
+  for (size_t i = 0; i < prefixes.size() / 2; ++i) {
+    auto& p = prefixes[i];
+    p.nh += PREFIXES;
+    fib.add(p.prefix, p.depth, p.nh);
+    rules[p.depth][p.prefix] = p.nh;
+  }
+  check(fib, addrs, "ADD AGAIN");
+
+  std::shuffle(addrs.begin(), addrs.end(), rng);
+  printf("%-12s %12s\n", "lookup", "ns/lookup");
+  printf("%-12s %12.1f\n", "fib", nsPerLookup(fib, addrs));
+  printf("%-12s %12.1f\n", "scan", nsPerScan(prefixes, addrs));
+  return 0;
+}
@@ -0,0 +1,151 @@
+/**
+ * @file testFibRcu.cpp
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-07
+ *
+ * @brief Test: lookups of the FIB while a writer adds and deletes long
+ * prefixes. Readers look up in critical sections and check that the next hop
+ * found is alive and covers the address. The writer frees next hops and groups
+ * of tbl8 only after a grace period, and poisons the next hops freed, so that
+ * one reclaimed too early is seen by readers.
+ *
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <random>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include "fib.h"
+#include "rcu.h"
+#include "type.h"
+
+#define READERS 2
+// rounds of the writer, more until readers have looked up enough
+#define ROUNDS 2000
+#define MIN_LOOKUPS 200000
+#define PREFIXES_PER_ROUND 16
+#define NEXTHOPS 1024
+
+// addresses looked up: 10.0.0.0/20, covered by 10.0.0.0/8 all the time
+#define BASE 0x0a000000u
+#define SPAN 4096
+
+#define ALIVE 0x600du
+#define POISON 0xdeadu
+
+uint32_t depthMask(int depth) { return depth ? ~0u << (32 - depth) : 0; }
+
+struct NextHop {
+  std::atomic<uint32_t> magic{0};
+  std::atomic<uint32_t> prefix{0};
+  std::atomic<int> depth{0};
+};
+
+NextHop nextHops[NEXTHOPS];
+std::atomic<bool> stop{false};
+std::atomic<long> lookups{0}, mismatches{0};
+
+void reader(Fib::Fib& fib, int seed) {
+  std::mt19937 rng(seed);
+  while (!stop.load()) {
+    uint32_t ip = BASE + rng() % SPAN;
+    Rcu::ReadGuard guard;
+    uint32_t nh = fib.lookup(ip);
+    // a slow reader: the writer goes on before the next hop is checked
+    std::this_thread::yield();
+    bool ok = nh < NEXTHOPS;
+    if (ok) {
+      auto& h = nextHops[nh];
+      int depth = h.depth.load(std::memory_order_relaxed);
+      ok = h.magic.load(std::memory_order_relaxed) == ALIVE &&
+           (ip & depthMask(depth)) == h.prefix.load(std::memory_order_relaxed);
+    }
+    if (!ok && mismatches++ < 8)
+      LOG_ERR("Mismatched: %08x, next hop: %u", ip, nh);
+    ++lookups;
+  }
+}
+
+int main() {
+  Fib::Fib fib;
+  nextHops[0].prefix = BASE;
+  nextHops[0].depth = 8;
+  nextHops[0].magic = ALIVE;
+  fib.add(BASE, 8, 0);
+
+  std::vector<uint32_t> freeIds;
+  for (uint32_t id = NEXTHOPS - 1; id > 0; --id) freeIds.push_back(id);
+
+  std::thread readers[READERS];
+  for (int i = 0; i < READERS; ++i)
+    readers[i] = std::thread(reader, std::ref(fib), i + 1);
+
+  std::mt19937 rng(0);
+  std::vector<uint32_t> live;
+  std::unordered_set<uint64_t> prefixes;  // of live next hops
+  int groupsMax = 0;
+  int rounds = 0;
+  for (; rounds < ROUNDS || lookups < MIN_LOOKUPS; ++rounds) {
+    // new prefixes of 25 to 32 bits, which expand groups of tbl8
+    std::vector<uint32_t> added;
+    for (int k = 0; k < PREFIXES_PER_ROUND && !freeIds.empty(); ++k) {
+      uint32_t id = freeIds.back();
+      int depth = 25 + rng() % 8;
+      uint32_t prefix = (BASE + rng() % SPAN) & depthMask(depth);
+      // adding it again would change the next hop of a live one
+      if (!prefixes.insert(static_cast<uint64_t>(prefix) << 8 | depth).second)
+        continue;
+      auto& h = nextHops[id];
+      h.prefix.store(prefix, std::memory_order_relaxed);
+      h.depth.store(depth, std::memory_order_relaxed);
+      h.magic.store(ALIVE, std::memory_order_relaxed);
+      if (fib.add(prefix, depth, id) < 0) {
+        LOG_ERR("Failed to add %08x/%d", prefix, depth);
+        prefixes.erase(static_cast<uint64_t>(prefix) << 8 | depth);
+        continue;
+      }
+      freeIds.pop_back();
+      added.push_back(id);
+    }
+
+    // delete those of the round before, groups emptied collapse
+    std::vector<uint32_t> deleted;
+    for (auto id : live) {
+      auto& h = nextHops[id];
+      uint32_t prefix = h.prefix.load();
+      int depth = h.depth.load();
+      if (fib.del(prefix, depth) < 0)
+        LOG_ERR("Failed to delete %08x/%d", prefix, depth);
+      prefixes.erase(static_cast<uint64_t>(prefix) << 8 | depth);
+      deleted.push_back(id);
+    }
+    live.swap(added);
+    groupsMax = std::max(groupsMax, fib.groupsUsed());
+
+    // nobody reads them after a grace period
+    Rcu::domain.synchronize();
+    fib.reclaim();
+    for (auto id : deleted) {
+      nextHops[id].magic.store(POISON, std::memory_order_relaxed);
+      freeIds.push_back(id);
+    }
+    // let readers in between changes, even on one CPU
+    std::this_thread::yield();
+  }
+
+  stop = true;
+  for (auto& t : readers) t.join();
+
+  if (mismatches)
+    LOG_ERR("case 1 [ CONCURRENT ] %ld of %ld lookups mismatched.",
+            mismatches.load(), lookups.load())
+  else
+    LOG_INFO("case 1 [ CONCURRENT ] %ld lookups in %d rounds agree, %d groups "
+             "of tbl8 used at most.",
+             lookups.load(), rounds, groupsMax);
+  return mismatches ? 1 : 0;
+}
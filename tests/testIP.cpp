@@ -12,14 +12,13 @@
 #include "ip.h"
 
 int myIpCallback(const void* buf, int len) {
-  Ip::IpPacket ipp((u_char*)buf, len);
-  Printer::printIpPacket(ipp);
+  Printer::printIpPacket(Ip::IpView(buf, len));
   return 0;
 }
 
 int main(int argc, char* argv[]) {
   api::init();
-  api::setIPPacketReceiveCallback(myIpCallback);
+  api::setProtocolCallback(IPPROTO_UDP, myIpCallback);
   api::addAllDevice(true);
 
   std::string srcStr, dstStr, msg, tmp;
@@ -0,0 +1,40 @@
+/**
+ * @file testPing.cpp
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-07
+ *
+ * @brief Test: answer echo requests, and probe RTT of a host.
+ *
+ */
+
+#include "api.h"
+#include "icmp.h"
+
+int main(int argc, char* argv[]) {
+  api::init();
+  api::addAllDevice(true);
+  api::initRouter();
+
+  std::string dstStr, tmp;
+  int count = 10;
+
+  while (true) {
+    std::cout << "Input an ip address to probe: ";
+    std::getline(std::cin, tmp);
+    if (tmp == "end") break;
+    if (tmp != "") dstStr = tmp;
+    std::cout << "Input number of requests: ";
+    std::getline(std::cin, tmp);
+    if (tmp != "") count = std::stoi(tmp);
+
+    ip_addr dst;
+    inet_aton(dstStr.c_str(), &dst);
+    Icmp::ProbeStats stats;
+    if (Icmp::probe(dst, count, stats) < 0) continue;
+    Printer::printProbeStats(dst, stats);
+  }
+
+  Device::deviceMgr.keepReceiving();
+  return 0;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file testUdp.cpp
+ * @author guanzhichao (vbcpascal@gmail.com)
+ * @version 0.1
+ * @date 2019-12-07
+ *
+ * @brief Test: UDP echo server. It will call functions of api::socket if
+ * `TEST_API` defined. Or it will call the functions of system.
+ *
+ */
+
+#include "api.h"
+
+#define TEST_API
+
+#ifdef TEST_API
+#define CALL(f, ...) api::socket::f(__VA_ARGS__)
+#else
+#define CALL(f, ...) f(__VA_ARGS__)
+#endif
+
+int main(int argc, char* argv[]) {
+  printf(
+      "Usage: ./testUdp serverIP serverPort\n"
+      "  For example: ./testUdp 10.100.1.2 4096\n");
+  if (argc < 3) return 0;
+
+  ip_addr ip;
+  if (inet_aton(argv[1], &ip) <= 0) {
+    LOG_ERR("Ip address error: %s", argv[1]);
+    return 0;
+  }
+  int port = std::atoi(argv[2]);
+
+  sockaddr srcSock, dstSock;
+  socklen_t dstSockLen;
+  Socket::SocketAddr(ip, port).get(&srcSock);
+
+  int fd = CALL(socket, AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (fd < 0 || CALL(bind, fd, &srcSock, sizeof(sockaddr_in)) < 0) {
+    LOG_ERR("Bind failed. errno: %d", errno);
+    return 0;
+  }
+  LOG_INFO("Echo UDP datagrams on %s:%d", argv[1], port);
+
+  char buf[2048];
+  while (true) {
+    auto n = CALL(recvfrom, fd, buf, sizeof(buf), 0, &dstSock, &dstSockLen);
+    if (n < 0) break;
+    LOG_INFO("Receive %zd bytes from %s", n,
+             Socket::SocketAddr(&dstSock).toStr().c_str());
+    CALL(sendto, fd, buf, n, 0, &dstSock, dstSockLen);
+  }
+  CALL(close, fd);
+  return 0;
+}